@@ -6,9 +6,415 @@
 
 static int ADC;
 
-static void adc_task(int dummy) {
-    int client, chan;
+#ifndef UBIT_V1
+/* Besides single readings, the driver on the Pico and the V2 can
+sample a set of channels continuously at a fixed rate into a ring of
+blocks in the client's memory, each block holding whole rounds of
+samples in increasing channel order.  At the end of each block the
+driver notifies the client with ping(), so a client that falls behind
+delays no one; it is told in m.int2 how many blocks it missed, and
+those blocks will have been overwritten. */
+
+/* Message types */
+#define STREAM_ON 16
+#define STREAM_OFF 17
+
+static struct {
+    int client;                 /* Process to notify, or 0 if stopped */
+    unsigned short *buf;        /* The ring of blocks */
+    int blocksize, nblocks;
+    unsigned mask;              /* Channels in use */
+#ifdef PI_PICO
+    byte pads[5];               /* Saved pad settings */
+#endif
+} stream;
+#endif
+
+#ifdef PI_PICO
+/* On the Pico, the ADC runs freely in round-robin mode, and DMA
+channel ADC_DMA copies
+results from the FIFO into one block, then chains to channel
+ADC_DMA+1, which fetches the address of the next block from a table
+and restarts the first channel.  The table wraps by the DMA ring
+feature, so the ring goes on with no help from the processor, and can
+never write outside the buffer.
+
+The ADC clock runs from the crystal (see startup.c), so conversions of
+96 cycles limit the total rate to 125k samples/sec. */
+
+#define ADC_DMA 2               /* Data channel, and control channel after */
+#define ADC_CLK_HZ 12000000     /* Frequency of clk_adc */
+#define ADC_CYCLES 96           /* Cycles per conversion */
+#define ADC_RING 16             /* Entries in block table, a power of 2 */
+#define ADC_RING_BITS 6         /* log2 of the table size in bytes */
+
+#define N_ADC_CHANS 5           /* Inputs 0..3 and temperature sensor */
+
+static unsigned short *ring_table[ADC_RING]
+     __attribute__((aligned(4*ADC_RING)));
+
+/* pad_analog -- prepare the pad for an ADC input, returning old state */
+static byte pad_analog(int chan)
+{
+    volatile unsigned *pad = &PADS_BANK0_GPIO0 + GPIO_26_ADC0 + chan;
+    byte old = *pad & (BIT(PADS_GPIO_IE) | BIT(PADS_GPIO_OD));
+
+    CLR_BIT(*pad, PADS_GPIO_IE);
+    SET_BIT(*pad, PADS_GPIO_OD);
+    return old;
+}
+
+/* pad_restore -- put back the settings saved by pad_analog */
+static void pad_restore(int chan, byte old)
+{
+    volatile unsigned *pad = &PADS_BANK0_GPIO0 + GPIO_26_ADC0 + chan;
+    *pad = (*pad & ~(BIT(PADS_GPIO_IE) | BIT(PADS_GPIO_OD))) | old;
+}
+
+/* stream_start -- begin sampling the channels in mask into a ring */
+static int stream_start(unsigned mask, unsigned rate,
+                        unsigned short *buf, int blocksize, int nblocks)
+{
+    int data = ADC_DMA, ctrl = ADC_DMA+1;
+    int nchans = 0, first = -1;
+    unsigned total, div;
+
+    for (int c = N_ADC_CHANS-1; c >= 0; c--) {
+        if (mask & BIT(c)) {
+            nchans++; first = c;
+        }
+    }
+
+    /* Blocks must hold whole rounds, and their number must divide
+       the table size */
+    if (nchans == 0 || mask >= BIT(N_ADC_CHANS) || rate == 0
+        || blocksize <= 0 || blocksize % nchans != 0
+        || nblocks < 2 || nblocks > ADC_RING || ADC_RING % nblocks != 0)
+        return ERR;
+
+    total = rate * nchans;
+    if (total > ADC_CLK_HZ / ADC_CYCLES) return ERR;
+    div = ((unsigned) ADC_CLK_HZ << 8) / total - 256; /* 16.8 fixed point */
+    if (div >= BIT(24)) return ERR;
+
+    stream.buf = buf;
+    stream.blocksize = blocksize;
+    stream.nblocks = nblocks;
+    stream.mask = mask;
+
+    /* The pads are set up once for the whole stream */
+    for (int c = 0; c < N_ADC_CHANS; c++) {
+        if (c != MUX_TEMP && (mask & BIT(c)))
+            stream.pads[c] = pad_analog(c);
+    }
+
+    ADC_CS = BIT(ADC_CS_EN) | (mask & BIT(MUX_TEMP) ? BIT(ADC_CS_TS_EN) : 0);
+    while (!GET_BIT(ADC_CS, ADC_CS_READY)) { /* wait */ }
+    ADC_DIV = div;
+    ADC_INTE = 0;
+    ADC_FCS = BIT(ADC_FCS_EN) | BIT(ADC_FCS_DREQ_EN)
+        | FIELD(ADC_FCS_THRESH, 1)
+        | BIT(ADC_FCS_UNDER) | BIT(ADC_FCS_OVER); /* Clear errors */
+    while (!GET_BIT(ADC_FCS, ADC_FCS_EMPTY)) (void) ADC_FIFO;
+
+    for (int i = 0; i < ADC_RING; i++)
+        ring_table[i] = &buf[(i % nblocks) * blocksize];
+
+    /* The control channel starts at the second block, since the data
+       channel is started on the first */
+    DMA_CHAN(ctrl, READ_ADDR) = (unsigned) &ring_table[1];
+    DMA_CHAN(ctrl, WRITE_ADDR) = (unsigned) &DMA_CHAN(data, AL2_WRITE_ADDR_TRIG);
+    DMA_CHAN(ctrl, TRANS_COUNT) = 1;
+    DMA_CHAN(ctrl, AL1_CTRL) = BIT(DMA_CTRL_EN)
+        | FIELD(DMA_CTRL_DATA_SIZE, DMA_SIZE_WORD)
+        | BIT(DMA_CTRL_INCR_READ)
+        | FIELD(DMA_CTRL_RING_SIZE, ADC_RING_BITS)
+        | FIELD(DMA_CTRL_CHAIN_TO, ctrl)
+        | FIELD(DMA_CTRL_TREQ_SEL, DREQ_PERMANENT)
+        | BIT(DMA_CTRL_IRQ_QUIET);
+
+    DMA_INTS0 = BIT(data);
+    DMA_INTE0 |= BIT(data);
+
+    DMA_CHAN(data, READ_ADDR) = (unsigned) &ADC_FIFO;
+    DMA_CHAN(data, WRITE_ADDR) = (unsigned) buf;
+    DMA_CHAN(data, TRANS_COUNT) = blocksize;
+    DMA_CHAN(data, CTRL_TRIG) = BIT(DMA_CTRL_EN)
+        | BIT(DMA_CTRL_HIGH_PRIORITY)
+        | FIELD(DMA_CTRL_DATA_SIZE, DMA_SIZE_HALFWORD)
+        | BIT(DMA_CTRL_INCR_WRITE)
+        | FIELD(DMA_CTRL_CHAIN_TO, ctrl)
+        | FIELD(DMA_CTRL_TREQ_SEL, DREQ_ADC);
+
+    /* Round robin goes upwards from AINSEL, so each block begins
+       with the lowest channel */
+    ADC_CS |= FIELD(ADC_CS_AINSEL, first) | FIELD(ADC_CS_RROBIN, mask)
+        | BIT(ADC_CS_START_MANY);
+
+    return OK;
+}
+
+/* stream_stop -- stop sampling and put things back as they were */
+static void stream_stop(void)
+{
+    unsigned chans = BIT(ADC_DMA) | BIT(ADC_DMA+1);
+
+    CLR_BIT(ADC_CS, ADC_CS_START_MANY);
+    while (!GET_BIT(ADC_CS, ADC_CS_READY)) { /* wait */ }
+
+    DMA_INTE0 &= ~BIT(ADC_DMA);
+    DMA_CHAN_ABORT = chans;
+    while (DMA_CHAN_ABORT & chans) { /* wait */ }
+    DMA_INTS0 = BIT(ADC_DMA);
+
+    ADC_CS = 0;
+    ADC_FCS = BIT(ADC_FCS_EN) | BIT(ADC_FCS_ERR) | FIELD(ADC_FCS_THRESH, 1)
+        | BIT(ADC_FCS_UNDER) | BIT(ADC_FCS_OVER);
+    while (!GET_BIT(ADC_FCS, ADC_FCS_EMPTY)) (void) ADC_FIFO;
+    ADC_INTE = BIT(ADC_INTR_FIFO);
+
+    for (int c = 0; c < N_ADC_CHANS; c++) {
+        if (c != MUX_TEMP && (stream.mask & BIT(c)))
+            pad_restore(c, stream.pads[c]);
+    }
+
+    stream.client = 0;
+}
+
+/* stream_interrupt -- notify the client that a block is full */
+static void stream_interrupt(void)
+{
+    if (stream.client != 0 && (DMA_INTS0 & BIT(ADC_DMA))) {
+        unsigned addr;
+        int cur;
+
+        DMA_INTS0 = BIT(ADC_DMA);
+
+        /* The data channel has moved on to the next block, or is about
+           to start it; either way the block before is the one just
+           filled */
+        addr = DMA_CHAN(ADC_DMA, WRITE_ADDR);
+        cur = (addr - (unsigned) stream.buf) / (2 * stream.blocksize);
+        cur = (cur + stream.nblocks - 1) % stream.nblocks;
+        ping(stream.client, (int) &stream.buf[cur * stream.blocksize]);
+    }
+
+    clear_pending(DMA_IRQ_0);
+    enable_irq(DMA_IRQ_0);
+}
+#endif
+
+#ifdef UBIT_V2
+/* Channel configuration: compare 1/4 of the input with 1/4 of Vdd
+with acquisition window of 10 microsec.  (Yes, micro not pico.) */
+#define SAADC_CONFIG (FIELD(ADC_CONFIG_GAIN, ADC_GAIN_1_4) \
+                      | FIELD(ADC_CONFIG_REFSEL, ADC_REFSEL_VDD_1_4) \
+                      | FIELD(ADC_CONFIG_TACQ, ADC_TACQ_10us))
+
+/* On the V2, one SAADC channel is set up for each input, and each
+SAMPLE task converts all of them and stores the results by EasyDMA.
+TIMER2 triggers SAMPLE through PPI channel ADC_PPI at the sample rate,
+and PPI channel ADC_PPI+1 restarts the SAADC from its END event, so it
+moves straight on to the next block.  RESULT.PTR is double-buffered:
+the address of the next block is written when the SAADC signals
+STARTED for the one before.  The processor is needed only twice per
+block, and a late interrupt at worst makes the SAADC fill the same
+block again.  Samples are signed, and may be slightly negative. */
+
+#define ADC_PPI 0               /* PPI channels ADC_PPI and ADC_PPI+1 */
+#define N_ADC_CHANS 8           /* Inputs AIN0 to AIN7 */
+#define SCAN_US 12              /* Microsec per channel: TACQ + 2 */
+
+static int filling;             /* Block the SAADC is filling */
+static int queued;              /* Block whose address is in RESULT.PTR */
+
+/* stream_start -- begin sampling the channels in mask into a ring */
+static int stream_start(unsigned mask, unsigned rate,
+                        unsigned short *buf, int blocksize, int nblocks)
+{
+    int nchans = 0, k = 0;
+    unsigned period;
+
+    for (int c = 0; c < N_ADC_CHANS; c++) {
+        if (mask & BIT(c)) nchans++;
+    }
+
+    if (nchans == 0 || rate == 0 || blocksize <= 0
+        || blocksize % nchans != 0 || nblocks < 2)
+        return ERR;
+
+    period = 1000000 / rate;
+    if (period < SCAN_US * nchans) return ERR;
+
+    stream.buf = buf;
+    stream.blocksize = blocksize;
+    stream.nblocks = nblocks;
+    stream.mask = mask;
+
+    /* Channels are set up once for the whole stream */
+    for (int c = 0; c < N_ADC_CHANS; c++) {
+        if (mask & BIT(c)) {
+            ADC_CHAN[k].CONFIG = SAADC_CONFIG;
+            ADC_CHAN[k].PSELP = c+1;
+            k++;
+        }
+    }
+
+    ADC_INTEN = BIT(ADC_INT_STARTED) | BIT(ADC_INT_END);
+    ADC_STARTED = ADC_END = 0;
+    ADC_RESULT.PTR = buf;
+    ADC_RESULT.MAXCNT = blocksize;
+    filling = -1; queued = 0;
+    ADC_ENABLE = 1;
+
+    TIMER2_STOP = 1;
+    TIMER2_MODE = TIMER_MODE_Timer;
+    TIMER2_BITMODE = TIMER_BITMODE_32Bit;
+    TIMER2_PRESCALER = 4;      // 1MHz = 16MHz / 2^4
+    TIMER2_CLEAR = 1;
+    TIMER2_CC[0] = period;
+    TIMER2_SHORTS = BIT(TIMER_COMPARE0_CLEAR);
+
+    PPI_CH[ADC_PPI].EEP = &TIMER2_COMPARE[0];
+    PPI_CH[ADC_PPI].TEP = &ADC_SAMPLE;
+    PPI_CH[ADC_PPI+1].EEP = &ADC_END;
+    PPI_CH[ADC_PPI+1].TEP = &ADC_START;
+    PPI_CHENSET = BIT(ADC_PPI) | BIT(ADC_PPI+1);
+
+    ADC_START = 1;
+    TIMER2_START = 1;
+    return OK;
+}
+
+/* stream_stop -- stop sampling and put things back as they were */
+static void stream_stop(void)
+{
+    PPI_CHENCLR = BIT(ADC_PPI) | BIT(ADC_PPI+1);
+    TIMER2_STOP = 1;
+    ADC_STOPPED = 0;
+    ADC_STOP = 1;
+    while (!ADC_STOPPED) { /* wait */ }
+    ADC_STOPPED = 0;
+    ADC_ENABLE = 0;
+
+    /* Single readings use just channel 0 */
+    for (int k = 1; k < N_ADC_CHANS; k++)
+        ADC_CHAN[k].PSELP = 0;
+    ADC_CHAN[0].CONFIG = SAADC_CONFIG;
+
+    ADC_INTEN = BIT(ADC_INT_END) | BIT(ADC_INT_CALDONE);
+    ADC_STARTED = ADC_END = 0;
+    clear_pending(ADC_IRQ);
+    enable_irq(ADC_IRQ);
+
+    stream.client = 0;
+}
+
+/* stream_interrupt -- pass on a full block and queue the next */
+static void stream_interrupt(void)
+{
+    if (stream.client != 0) {
+        /* Deal with END first, in case both have happened */
+        if (ADC_END) {
+            ADC_END = 0;
+            if (filling >= 0)
+                ping(stream.client,
+                     (int) &stream.buf[filling * stream.blocksize]);
+        }
+
+        if (ADC_STARTED) {
+            ADC_STARTED = 0;
+            filling = queued;
+            queued = (queued + 1) % stream.nblocks;
+            ADC_RESULT.PTR = &stream.buf[queued * stream.blocksize];
+        }
+    }
+
+    clear_pending(ADC_IRQ);
+    enable_irq(ADC_IRQ);
+}
+#endif
+
+/* A request asks for 4^bits conversions, which are added up and
+shifted right by bits, giving bits more bits of resolution if there is
+enough noise to dither the input.  With the flag ADC_MEDIAN, each
+sample is first replaced by the median of it and the two before, which
+removes isolated spikes before they can bias the sum.  The min, max and
+median use masks made from the sign of a difference, not comparisons,
+since the Cortex-M0+ has no conditional execution. */
+
+/* imin, imax -- minimum and maximum of values far from overflow */
+static inline int imin(int a, int b) {
+    int d = a - b;
+    return b + (d & (d >> 31));
+}
+
+static inline int imax(int a, int b) {
+    int d = a - b;
+    return a - (d & (d >> 31));
+}
+
+/* median3 -- median of three values */
+static inline int median3(int a, int b, int c) {
+    return imax(imin(a, b), imin(imax(a, b), c));
+}
+
+/* adc_convert -- carry out one conversion */
+static int adc_convert(int chan) {
     short result;
+
+#ifdef UBIT_V1
+    SET_FIELD(ADC_CONFIG, ADC_CONFIG_PSEL, BIT(chan));
+    ADC_ENABLE = 1;
+    ADC_START = 1;
+    receive(INTERRUPT, NULL);
+    assert(ADC_END);
+    result = ADC_RESULT;
+    ADC_END = 0;
+    ADC_ENABLE = 0;
+#endif
+
+#ifdef UBIT_V2
+    ADC_CHAN[0].PSELP = chan+1;
+    ADC_ENABLE = 1;
+    ADC_RESULT.PTR = &result;
+    ADC_RESULT.MAXCNT = 1;
+    ADC_START = 1;
+    ADC_SAMPLE = 1;
+    receive(INTERRUPT, NULL);
+    assert(ADC_END);
+    assert(ADC_RESULT.AMOUNT == 1);
+    ADC_END = 0;
+    ADC_ENABLE = 0;
+
+    // Result can still be slightly negative even after calibration
+    if (result < 0) result = 0;
+#endif
+
+#ifdef PI_PICO
+    //chan is pin or virtual pin if temperature sensor
+    SET_FIELD(ADC_CS, ADC_CS_AINSEL, chan);
+    SET_BIT(ADC_CS, ADC_CS_EN);
+    SET_BIT(ADC_CS, ADC_CS_START_ONCE);
+
+    // Sleep until the result arrives in the FIFO; reading it
+    // empties the FIFO and removes the interrupt.  A conversion
+    // error still gives a value, as the polling driver did.
+    receive(INTERRUPT, NULL);
+    assert(GET_BIT(ADC_INTS, ADC_INTR_FIFO));
+    result = GET_FIELD(ADC_FIFO, ADC_FIFO_VAL);
+#endif
+
+    clear_pending(ADC_IRQ);
+    enable_irq(ADC_IRQ);
+    return result;
+}
+
+static void adc_task(int dummy) {
+    int client, n, median, sum, result, a, b, y;
+#ifdef PI_PICO
+    byte pad = 0;
+#endif
     message m;
 
 #ifdef UBIT_V1
@@ -21,19 +427,25 @@ static void adc_task(int dummy) {
 #endif
 
 #ifdef UBIT_V2
-    // Initialise the SAADC: 10 bit resolution,
-    // compare 1/4 if the input with 1/4 of Vdd with
-    // acquisition window of 10 microsec.  (Yes, micro not pico.)
-    ADC_CHAN[0].CONFIG = FIELD(ADC_CONFIG_GAIN, ADC_GAIN_1_4)
-        | FIELD(ADC_CONFIG_REFSEL, ADC_REFSEL_VDD_1_4)
-        | FIELD(ADC_CONFIG_TACQ, ADC_TACQ_10us);
+    // Initialise the SAADC: 10 bit resolution, with channel 0
+    // configured as SAADC_CONFIG for single readings
+    ADC_CHAN[0].CONFIG = SAADC_CONFIG;
     ADC_RESOLUTION = ADC_RESOLUTION_10bit;
     ADC_INTEN = BIT(ADC_INT_END) | BIT(ADC_INT_CALDONE);
 #endif
 
-#ifndef PI_PICO
+#ifdef PI_PICO
+    // Each conversion goes into the FIFO, and the FIFO interrupt comes
+    // when it holds a result; the error flag travels with the result.
+    ADC_FCS = BIT(ADC_FCS_EN) | BIT(ADC_FCS_ERR) | FIELD(ADC_FCS_THRESH, 1);
+    ADC_INTE = BIT(ADC_INTR_FIFO);
+#endif
+
     connect(ADC_IRQ);
     enable_irq(ADC_IRQ);
+#ifdef PI_PICO
+    connect(DMA_IRQ_0);
+    enable_irq(DMA_IRQ_0);
 #endif
  
 #ifdef UBIT_V2
@@ -50,64 +462,77 @@ static void adc_task(int dummy) {
 
     while (1) {
         receive(ANY, &m);
-        assert(m.type == REQUEST);
         client = m.sender;
-        chan = m.int1;
 
-#ifdef UBIT_V1
-        SET_FIELD(ADC_CONFIG, ADC_CONFIG_PSEL, BIT(chan));
-        ADC_ENABLE = 1;
-        ADC_START = 1;
-        receive(INTERRUPT, NULL);
-        assert(ADC_END);
-        result = ADC_RESULT;
-        ADC_END = 0;
-        ADC_ENABLE = 0;
-#endif
+#ifndef UBIT_V1
+        switch (m.type) {
+        case REQUEST:
+            break;
 
-#ifdef UBIT_V2
-        ADC_CHAN[0].PSELP = chan+1;
-        ADC_ENABLE = 1;
-        ADC_RESULT.PTR = &result;
-        ADC_RESULT.MAXCNT = 1;
-        ADC_START = 1;
-        ADC_SAMPLE = 1;
-        receive(INTERRUPT, NULL);
-        assert(ADC_END);
-        assert(ADC_RESULT.AMOUNT == 1);
-        ADC_END = 0;
-        ADC_ENABLE = 0;
-
-        // Result can still be slightly negative even after calibration
-        if (result < 0) result = 0;
+        case STREAM_ON:
+            if (stream.client != 0)
+                m.int1 = ERR;
+            else {
+                m.int1 = stream_start(m.byte1, m.int2, m.ptr3,
+                                      m.byte3 | (m.byte4 << 8), m.byte2);
+                if (m.int1 == OK) stream.client = client;
+            }
+            send_int(client, REPLY, m.int1);
+            continue;
+
+        case STREAM_OFF:
+            if (stream.client != 0) stream_stop();
+            send_int(client, REPLY, OK);
+            continue;
+
+        case INTERRUPT:
+            stream_interrupt();
+            continue;
+
+        default:
+            badmesg(m.type);
+        }
+
+        /* No single readings while streaming */
+        if (stream.client != 0) {
+            send_int(client, REPLY, -1);
+            continue;
+        }
+#else
+        assert(m.type == REQUEST);
 #endif
 
 #ifdef PI_PICO
-//not sorted out FIFO interrupt FCS mechanism yet so just yield() from busy 
-     //chan is pin or virtual pin if temperature sensor
-      //ADC_CS should be 0 when we enter here
-      SET_FIELD(ADC_CS, ADC_CS_AINSEL, chan);
-      SET_BIT(ADC_CS, ADC_CS_EN);
+        // Enable the temperature sensor, or make the pin analog
+        if (m.int1 == MUX_TEMP)
+            ADC_CS = BIT(ADC_CS_TS_EN);
+        else {
+            ADC_CS = 0;
+            pad = pad_analog(m.int1);
+        }
+#endif
 
-      SET_BIT(ADC_CS, ADC_CS_START_ONCE);
-      while (GET_BIT(ADC_CS, ADC_CS_READY) == 0)
-      {
-         yield();
-         if (GET_BIT(ADC_CS, ADC_CS_ERR) == 1)
-         {//handle error here
-          //for now just break;
-             break;
-         }
-      }
-      result = ADC_RESULT;
+        n = 1 << (2*m.int2);
+        median = m.int3 & ADC_MEDIAN;
+        sum = 0;
 
-      ADC_CS = 0;
+        for (int i = 0; i < n; i++) {
+            int x = adc_convert(m.int1);
 
-#endif
+            if (median) {
+                if (i == 0) a = b = x;
+                y = median3(a, b, x);
+                a = b; b = x; x = y;
+            }
+            sum += x;
+        }
+
+        result = sum >> m.int2;
 
-#ifndef PI_PICO
-        clear_pending(ADC_IRQ);
-        enable_irq(ADC_IRQ);
+#ifdef PI_PICO
+        ADC_CS = 0;
+        if (m.int1 != MUX_TEMP)
+            pad_restore(m.int1, pad);
 #endif
 
         send_int(client, REPLY, result);
@@ -133,67 +558,98 @@ static const int chantab[] = {
     0
 };
 
-int adc_reading(int pin) {
-    int i, chan = -1;
-    message m;
-
-    for (i = 0; chantab[i] != 0; i += 2) {
-        if (chantab[i] == pin) {
-            chan = chantab[i+1];
-            break;
-        }
+/* adc_channel -- find the ADC channel for a pin */
+static int adc_channel(int pin) {
+    for (int i = 0; chantab[i] != 0; i += 2) {
+        if (chantab[i] == pin)
+            return chantab[i+1];
     }
 
-    if (chan < 0)
-        panic("Can't use pin %d for ADC", pin);
-
-#ifdef PI_PICO
-      unsigned char remember_ie;
-      unsigned char remember_od;
+    panic("Can't use pin %d for ADC", pin);
+    return -1;
+}
 
-      ADC_CS = 0;
+/* adc_filtered -- take 4^bits samples, optionally despiked, and return
+   their sum shifted right by bits */
+int adc_filtered(int pin, int bits, int flags) {
+    int chan = adc_channel(pin);
+    message m;
 
-      if (chan == GPIO_VIRT_TS)
-      {
-         SET_BIT(ADC_CS, ADC_CS_TS_EN);
-      }
-      else
-      {
-          volatile unsigned *gpio_reg = &PADS_BANK0_GPIO0 + pin;
-          remember_ie = GET_BIT(*gpio_reg, PADS_GPIO_IE);
-          remember_od = GET_BIT(*gpio_reg, PADS_GPIO_OD);
-          CLR_BIT(*gpio_reg, PADS_GPIO_IE);
-          SET_BIT(*gpio_reg, PADS_GPIO_OD);
-      }
-#endif
+    if (bits < 0 || bits > ADC_MAX_BITS)
+        panic("Can't oversample ADC by 4^%d", bits);
 
     m.type = REQUEST;
     m.int1 = chan;
+    m.int2 = bits;
+    m.int3 = flags;
     sendrec(ADC, &m);
+    return m.int1;
+}
+
+/* adc_reading -- take a single sample */
+int adc_reading(int pin) {
+    return adc_filtered(pin, 0, 0);
+}
+
+void adc_init(void) {
+    ADC = start("ADC", adc_task, 0, 256);
+}
 
 #ifdef PI_PICO
-      if (chan == GPIO_VIRT_TS)
-      {
-         CLR_BIT(ADC_CS, ADC_CS_TS_EN);
-      }
-      else
-      {
-          volatile unsigned *gpio_reg = &PADS_BANK0_GPIO0 + pin;
-          if (remember_ie == 0)
-             CLR_BIT(*gpio_reg, PADS_GPIO_IE);
-          else
-             SET_BIT(*gpio_reg, PADS_GPIO_IE);
-
-          if (remember_od == 0)
-             CLR_BIT(*gpio_reg, PADS_GPIO_OD);
-          else
-             SET_BIT(*gpio_reg, PADS_GPIO_OD);
-      }
+/* The temperature sensor gives 0.706V at 27C, falling by 1.721mV per
+degree (RP2040 datasheet 4.9.5), and the reference is 3.3V.  The
+reading is first scaled to 16 bits whatever the oversampling, so a
+single multiply and shift give the temperature, with constants
+K0 = 256 * (27 + 0.706/0.001721) and K1 = 1024 * 256 * 3.3 / (65536 *
+0.001721); the product stays within 32 bits. */
+
+#define TEMP_K0 111930
+#define TEMP_K1 7670
+
+/* adc_celsius -- convert a reading of the temperature sensor with bits
+   of oversampling to degrees Celsius times 256 */
+int adc_celsius(int raw, int bits) {
+    unsigned raw16 = (raw << 4) >> bits;
+    return TEMP_K0 - (int) ((raw16 * TEMP_K1) >> 10);
+}
+
 #endif
 
+#ifndef UBIT_V1
+/* adc_stream -- sample the pins continuously at rate samples/sec each,
+   filling a ring of nblocks blocks of blocksize samples in buf */
+int adc_stream(const int *pins, int npins, int rate,
+               unsigned short *buf, int blocksize, int nblocks) {
+    unsigned mask = 0;
+    message m;
+
+    for (int i = 0; i < npins; i++)
+        mask |= BIT(adc_channel(pins[i]));
+
+    m.type = STREAM_ON;
+    m.byte1 = mask;
+    m.byte2 = nblocks;
+    m.byte3 = blocksize & 0xff;
+    m.byte4 = blocksize >> 8;
+    m.int2 = rate;
+    m.ptr3 = buf;
+    sendrec(ADC, &m);
     return m.int1;
 }
 
-void adc_init(void) {
-    ADC = start("ADC", adc_task, 0, 256);
+/* adc_stream_wait -- wait for the next full block, setting *lost to the
+   number of blocks missed since the last */
+unsigned short *adc_stream_wait(int *lost) {
+    message m;
+    receive(PING, &m);
+    if (lost != NULL) *lost = m.int2;
+    return m.ptr1;
 }
+
+/* adc_stream_stop -- stop sampling */
+void adc_stream_stop(void) {
+    message m;
+    m.type = STREAM_OFF;
+    sendrec(ADC, &m);
+}
+#endif
@@ -0,0 +1,53 @@
+// ex-adcstream.c
+// Samples ADC0 continuously at 10kHz into a ring of blocks by DMA,
+// and reports the mean and peak-to-peak swing of each second's data,
+// as a start on vibration monitoring.
+
+#include "hardware.h"
+#include "microbian.h"
+#include "lib.h"
+
+#define RATE 10000
+#define BLOCK 500
+#define NBLOCKS 4
+
+static unsigned short ring[NBLOCKS * BLOCK];
+
+void monitor_task(int arg)
+{
+    static const int pins[] = { GPIO_26_ADC0 };
+    unsigned sum = 0, lo = 4095, hi = 0;
+    int nblocks = 0, missed = 0;
+
+    printf("ADC stream " __DATE__ " " __TIME__ "\n");
+
+    if (adc_stream(pins, 1, RATE, ring, BLOCK, NBLOCKS) != OK)
+        panic("Can't start ADC stream");
+
+    while (1) {
+        int lost;
+        unsigned short *block = adc_stream_wait(&lost);
+
+        for (int i = 0; i < BLOCK; i++) {
+            unsigned x = block[i];
+            sum += x;
+            if (x < lo) lo = x;
+            if (x > hi) hi = x;
+        }
+        missed += lost;
+
+        if (++nblocks == RATE / BLOCK) {
+            printf("mean %u, p-p %u, missed %d\n",
+                   sum / (nblocks * BLOCK), hi - lo, missed);
+            sum = 0; lo = 4095; hi = 0;
+            nblocks = missed = 0;
+        }
+    }
+}
+
+void init(void) {
+    serial_init();
+    timer_init();
+    adc_init();
+    start("Monitor", monitor_task, 0, STACK);
+}
@@ -0,0 +1,30 @@
+// ex-console.c
+// Prints a running count on the OLED, which scrolls like a terminal,
+// by redirecting printf to the display console.
+
+#include "hardware.h"
+#include "microbian.h"
+#include "lib.h"
+#include "ssd1306.h"
+
+void count_task(int arg)
+{
+    periodic tick;
+    int n = 0;
+
+    oled_console(1);
+    print_redirect(oled_print_buf);
+    printf("Console " __DATE__ "\n");
+
+    periodic_init(&tick, 500000);
+    while (1) {
+        periodic_wait(&tick);
+        printf("%d ticks, %u us\n", n++, timer_micros());
+    }
+}
+
+void init(void) {
+    timer_init();
+    oled_init(25);
+    start("Count", count_task, 0, STACK);
+}
@@ -0,0 +1,90 @@
+// ex-fmtbench.c
+// Measures the rate of number formatting: the division-based utoa
+// that lib.c used to have, against sprintf, which now uses shifts and
+// adds.  The sprintf figures include parsing the format and storing
+// the result, so they understate the gain in the conversion itself.
+
+#include "hardware.h"
+#include "microbian.h"
+#include "lib.h"
+
+#define NMAX 16
+#define COUNT 20000
+
+/* old_utoa -- lib.c's former conversion, one division per digit */
+static char *old_utoa(unsigned x, unsigned base, char *nbuf) {
+    char *p = &nbuf[NMAX];
+    const char *hex = "0123456789abcdef";
+
+    *--p = '\0';
+    do {
+        *--p = hex[x % base];
+        x = x / base;
+    } while (x != 0);
+
+    return p;
+}
+
+/* rate -- numbers per second given count and elapsed microseconds */
+static unsigned rate(unsigned n, unsigned usec) {
+    if (usec == 0) usec = 1;
+    return (unsigned) ((unsigned long long) n * 1000000 / usec);
+}
+
+void bench_task(int n)
+{
+    char buf[NMAX];
+    volatile char sink;
+    unsigned t0, t1, x;
+
+    printf("Format benchmark " __DATE__ " " __TIME__ "\n");
+
+    while (1) {
+        /* Decimal */
+        x = 1;
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT; i++) {
+            sink = *old_utoa(x, 10, buf);
+            x = x * 1664525 + 1013904223;
+        }
+        t1 = timer_micros();
+        printf("utoa %%u:    %u/sec\n", rate(COUNT, t1-t0));
+
+        x = 1;
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT; i++) {
+            sprintf(buf, "%u", x);
+            x = x * 1664525 + 1013904223;
+        }
+        t1 = timer_micros();
+        printf("sprintf %%u: %u/sec\n", rate(COUNT, t1-t0));
+
+        /* Hex */
+        x = 1;
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT; i++) {
+            sink = *old_utoa(x, 16, buf);
+            x = x * 1664525 + 1013904223;
+        }
+        t1 = timer_micros();
+        printf("utoa %%x:      %u/sec\n", rate(COUNT, t1-t0));
+
+        x = 1;
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT; i++) {
+            sprintf(buf, "%08x", x);
+            x = x * 1664525 + 1013904223;
+        }
+        t1 = timer_micros();
+        printf("sprintf %%08x: %u/sec\n\n", rate(COUNT, t1-t0));
+
+        (void) sink;
+        timer_delay(5000);
+    }
+}
+
+void init(void) {
+    serial_init();
+    timer_init();
+    start("Bench", bench_task, 0, STACK);
+}
@@ -0,0 +1,99 @@
+// ex-gfxbench.c
+// Measures the rate of the framebuffer graphics primitives in
+// oled-ssd1306.c, against drawing the same shapes a pixel at a time.
+// Nothing is sent to the display, so no OLED need be connected.
+
+#include "hardware.h"
+#include "microbian.h"
+#include "lib.h"
+#include "ssd1306.h"
+
+#define COUNT 2000
+
+/* A 16 x 16 bitmap in framebuffer format: two pages of 16 columns */
+static const byte sprite[32] = {
+    0xe0, 0x18, 0x04, 0x02, 0x02, 0x39, 0x79, 0x71,
+    0x71, 0x79, 0x39, 0x02, 0x02, 0x04, 0x18, 0xe0,
+    0x07, 0x18, 0x20, 0x40, 0x40, 0x9c, 0x9e, 0x8e,
+    0x8e, 0x9e, 0x9c, 0x40, 0x40, 0x20, 0x18, 0x07
+};
+
+/* rate -- operations per second given count and elapsed microseconds */
+static unsigned rate(unsigned n, unsigned usec) {
+    if (usec == 0) usec = 1;
+    return (unsigned) ((unsigned long long) n * 1000000 / usec);
+}
+
+/* slow_rect -- draw a filled rectangle pixel by pixel */
+static void slow_rect(int x, int y, int w, int h, int mode) {
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++)
+            ssd1306_pixel(x+j, y+i, mode);
+}
+
+/* slow_blit -- draw a bitmap pixel by pixel */
+static void slow_blit(int x, int y, const byte *bmp, int w, int h) {
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++)
+            if (bmp[(i/8)*w + j] & (1 << (i%8)))
+                ssd1306_pixel(x+j, y+i, PIXEL_ON);
+}
+
+void bench_task(int arg)
+{
+    unsigned t0, t1;
+
+    printf("Graphics benchmark " __DATE__ " " __TIME__ "\n");
+
+    while (1) {
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT; i++)
+            ssd1306_hline(i & 7, i & 31, 120, PIXEL_XOR);
+        t1 = timer_micros();
+        printf("hline 120:       %u/sec\n", rate(COUNT, t1-t0));
+
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT; i++)
+            ssd1306_vline(i & 127, i & 7, 24, PIXEL_XOR);
+        t1 = timer_micros();
+        printf("vline 24:        %u/sec\n", rate(COUNT, t1-t0));
+
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT; i++)
+            ssd1306_fill_rect(i & 7, i & 7, 64, 20, PIXEL_XOR);
+        t1 = timer_micros();
+        printf("rect 64x20:      %u/sec\n", rate(COUNT, t1-t0));
+
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT/10; i++)
+            slow_rect(i & 7, i & 7, 64, 20, PIXEL_XOR);
+        t1 = timer_micros();
+        printf("  by pixels:     %u/sec\n", rate(COUNT/10, t1-t0));
+
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT; i++)
+            ssd1306_blit(i & 63, i & 15, sprite, 16, 16, PIXEL_ON);
+        t1 = timer_micros();
+        printf("blit 16x16:      %u/sec\n", rate(COUNT, t1-t0));
+
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT/10; i++)
+            slow_blit(i & 63, i & 15, sprite, 16, 16);
+        t1 = timer_micros();
+        printf("  by pixels:     %u/sec\n", rate(COUNT/10, t1-t0));
+
+        t0 = timer_micros();
+        for (int i = 0; i < COUNT; i++)
+            ssd1306_cursor(i & 127, 8, 6, 8);
+        t1 = timer_micros();
+        printf("cursor 6x8:      %u/sec\n\n", rate(COUNT, t1-t0));
+
+        timer_delay(5000);
+    }
+}
+
+void init(void) {
+    serial_init();
+    timer_init();
+    start("Bench", bench_task, 0, STACK);
+}
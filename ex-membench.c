@@ -0,0 +1,66 @@
+// ex-membench.c
+// Measures memcpy, memmove and memset from pi-pico/startup.c for a
+// few sizes and alignments, reporting CPU cycles per 100 bytes.
+
+#include "hardware.h"
+#include "microbian.h"
+#include "lib.h"
+#include <string.h>
+
+#define REPEAT 1000
+
+static unsigned src[256], dst[256];
+
+static const int sizes[] = { 16, 64, 256, 1000 };
+#define N_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/* cycles -- convert a time for REPEAT operations of n bytes to
+   cycles per 100 bytes */
+static unsigned cycles(unsigned usec, int n) {
+    return (usec * (SYS_CLK_HZ / 1000000) / REPEAT) * 100 / n;
+}
+
+void bench_task(int arg)
+{
+    char *s = (char *) src, *d = (char *) dst;
+    unsigned t0, t1;
+
+    printf("Memory benchmark " __DATE__ " " __TIME__ "\n");
+
+    while (1) {
+        printf("size  memcpy  memcpy+1  memmove  memset\n");
+        for (int i = 0; i < N_SIZES; i++) {
+            int n = sizes[i];
+            printf("%4d", n);
+
+            t0 = TIMER_TIMELR;
+            for (int j = 0; j < REPEAT; j++) memcpy(d, s, n);
+            t1 = TIMER_TIMELR;
+            printf("  %6u", cycles(t1-t0, n));
+
+            t0 = TIMER_TIMELR;
+            for (int j = 0; j < REPEAT; j++) memcpy(d+1, s+2, n);
+            t1 = TIMER_TIMELR;
+            printf("  %8u", cycles(t1-t0, n));
+
+            t0 = TIMER_TIMELR;
+            for (int j = 0; j < REPEAT; j++) memmove(s+4, s, n);
+            t1 = TIMER_TIMELR;
+            printf("  %7u", cycles(t1-t0, n));
+
+            t0 = TIMER_TIMELR;
+            for (int j = 0; j < REPEAT; j++) memset(d, j, n);
+            t1 = TIMER_TIMELR;
+            printf("  %6u\n", cycles(t1-t0, n));
+        }
+        printf("(cycles per 100 bytes)\n\n");
+
+        timer_delay(5000);
+    }
+}
+
+void init(void) {
+    serial_init();
+    timer_init();
+    start("Bench", bench_task, 0, STACK);
+}
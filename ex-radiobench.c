@@ -0,0 +1,57 @@
+// ex-radiobench.c
+// Measures the radio transmit rate for back-to-back packets of
+// various sizes.  radio_send returns once the packet is queued, so
+// the time for a long burst is close to the time the radio spends
+// sending it.  Run ex-remote or another listener on a second board in
+// group 17 to see the packets arrive.
+
+#include "hardware.h"
+#include "microbian.h"
+#include "lib.h"
+
+#define GROUP 17
+#define COUNT 1000
+
+/* rate -- events per second given count and elapsed microseconds */
+static unsigned rate(unsigned n, unsigned usec) {
+    if (usec == 0) usec = 1;
+    return (unsigned) ((unsigned long long) n * 1000000 / usec);
+}
+
+void bench_task(int arg)
+{
+    static byte buf[RADIO_PACKET];
+    static const int size[] = { 1, 8, 16, RADIO_PACKET };
+    unsigned t0, t1, r;
+
+    printf("Radio benchmark " __DATE__ " " __TIME__ "\n");
+    radio_group(GROUP);
+
+    while (1) {
+        for (int k = 0; k < 4; k++) {
+            int n = size[k];
+
+            t0 = timer_micros();
+            for (int i = 0; i < COUNT; i++) {
+                buf[0] = i;
+                radio_send(buf, n);
+            }
+            t1 = timer_micros();
+
+            // Each packet has 12 bytes of preamble, address, header and CRC
+            r = rate(COUNT, t1-t0);
+            printf("%d bytes: %u packets/sec, %u kbit/s on air\n",
+                   n, r, r * (n+12) * 8 / 1000);
+        }
+
+        printf("\n");
+        timer_delay(5000);
+    }
+}
+
+void init(void) {
+    serial_init();
+    timer_init();
+    radio_init();
+    start("Bench", bench_task, 0, STACK);
+}
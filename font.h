@@ -26,10 +26,10 @@
   // Characters definition
   // -----------------------------------
   // number of columns for chars
-  #define CHARS_COLS_LENGTH  5
+  #define FONT_DEFAULT_WIDTH  5
 
   // @const Characters
-  static const char FONTS[][CHARS_COLS_LENGTH] = {
+  static const unsigned char FONT_DEFAULT[][FONT_DEFAULT_WIDTH] = {
     { 0x00, 0x00, 0x00, 0x00, 0x00 }, // 20 space
  //   { 0x81, 0x81, 0x18, 0x81, 0x81 }, // 21 !
     { 0x00, 0x00, 0x00, 0x5f, 0x00 }, // 21 !
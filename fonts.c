@@ -0,0 +1,78 @@
+/* fonts.c */
+
+#include "microbian.h"
+#include "fonts.h"
+
+#include "font.h"
+#include "font5x8.h"
+#include "font6x8.h"
+#include "font8x8.h"
+
+/* The glyph tables are in flash, and all four fonts are there
+together, so a program can change font as it runs.  For proportional
+spacing, each font has a table in RAM giving for each glyph the first
+column that has any pixels set and the number of columns from there to
+the last one, packed as (offset << 4) | width.  These are found by
+scanning the glyphs the first time the font is used proportionally; a
+blank glyph (the space) gets half the fixed width.  Since every glyph
+gets a width of at least one, a zero first entry means the table has
+not been filled yet. */
+
+#define NGLYPHS(t) (sizeof(t) / sizeof(t[0]))
+
+static byte metrics_default[NGLYPHS(FONT_DEFAULT)];
+static byte metrics_5x8[NGLYPHS(FONT_5x8)];
+static byte metrics_6x8[NGLYPHS(FONT_6x8)];
+static byte metrics_8x8[NGLYPHS(FONT_8x8)];
+
+#define FONT(t, w, m) { (const byte *) t, w, 32, NGLYPHS(t), m }
+
+const font font_default = FONT(FONT_DEFAULT, FONT_DEFAULT_WIDTH, metrics_default);
+const font font_5x8 = FONT(FONT_5x8, FONT_5x8_WIDTH, metrics_5x8);
+const font font_6x8 = FONT(FONT_6x8, FONT_6x8_WIDTH, metrics_6x8);
+const font font_8x8 = FONT(FONT_8x8, FONT_8x8_WIDTH, metrics_8x8);
+
+const byte font_expand2[16] = {
+    0x00, 0x03, 0x0c, 0x0f, 0x30, 0x33, 0x3c, 0x3f,
+    0xc0, 0xc3, 0xcc, 0xcf, 0xf0, 0xf3, 0xfc, 0xff
+};
+
+const unsigned short font_expand3[16] = {
+    0x000, 0x007, 0x038, 0x03f, 0x1c0, 0x1c7, 0x1f8, 0x1ff,
+    0xe00, 0xe07, 0xe38, 0xe3f, 0xfc0, 0xfc7, 0xff8, 0xfff
+};
+
+/* font_measure -- fill in the proportional metrics for a font */
+static void font_measure(const font *f)
+{
+    for (int i = 0; i < f->count; i++) {
+        const byte *g = &f->glyphs[i * f->width];
+        int lo = 0, hi = f->width-1;
+
+        while (lo <= hi && g[lo] == 0) lo++;
+        while (hi >= lo && g[hi] == 0) hi--;
+
+        if (lo > hi)
+            f->metrics[i] = (f->width+1)/2;
+        else
+            f->metrics[i] = (lo << 4) | (hi-lo+1);
+    }
+}
+
+const byte *font_glyph(const font *f, int ch, int prop, int *width)
+{
+    int i = ch - f->first;
+    const byte *g;
+
+    if (i < 0 || i >= f->count) i = '?' - f->first;
+    g = &f->glyphs[i * f->width];
+
+    if (!prop) {
+        *width = f->width;
+        return g;
+    }
+
+    if (f->metrics[0] == 0) font_measure(f);
+    *width = f->metrics[i] & 0xf;
+    return g + (f->metrics[i] >> 4);
+}
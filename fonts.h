@@ -0,0 +1,34 @@
+/* fonts.h */
+
+#ifndef __FONTS_H__
+#define __FONTS_H__
+
+/* Each font has one glyph for each character from first to
+first+count-1, stored as width columns of one byte each with the top
+pixel in the LSB.  That is the order in which the SSD1306 takes data
+within a page, so a glyph can be copied into the display RAM without
+transposing it. */
+
+typedef struct {
+    const unsigned char *glyphs;  /* count * width bytes */
+    unsigned char width;          /* Columns per glyph */
+    unsigned char first, count;   /* Range of characters */
+    unsigned char *metrics;       /* Proportional spacing, see fonts.c */
+} font;
+
+extern const font font_default, font_5x8, font_6x8, font_8x8;
+
+/* The font used for text until the program chooses another */
+#ifndef OLED_FONT
+#define OLED_FONT font_default
+#endif
+
+/* font_glyph -- find the columns for ch, and set *width to their number */
+const unsigned char *font_glyph(const font *f, int ch, int prop, int *width);
+
+/* Tables that spread each bit of a nibble into 2 or 3 bits, for
+drawing text at double or triple size */
+extern const unsigned char font_expand2[16];
+extern const unsigned short font_expand3[16];
+
+#endif
@@ -0,0 +1,240 @@
+/* gfxtest.c */
+
+/* Host test of the graphics primitives in oled-ssd1306.c.  Each
+drawing operation is also carried out a pixel at a time on a plain
+array, and after every one the framebuffer must match it exactly.  The
+columns that changed must also lie within the range marked dirty for
+their page, or a flush would miss them.  First every small rectangle
+and bitmap is drawn at every alignment of its ends within a word, over
+a random background, then a long run of random operations of all kinds
+with coordinates that often fall off the screen.
+
+Build with "make gfxtest", which uses the system cc. */
+
+#include "oled-ssd1306.c"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Stubs for the I2C driver and the rest of micro:bian */
+int i2c_xfer(int chan, int kind, int addr, byte *buf1, int n1,
+             byte *buf2, int n2) { return OK; }
+int i2c_batch(int chan, i2c_op *ops, int n) { return OK; }
+void i2c_batch_start(int chan, i2c_op *ops, int n) { }
+void i2c_init(int chan) { }
+int start(char *name, void (*body)(int), int arg, int stksize) { return 1; }
+void send(int dest, message *msg) { }
+void send_msg(int dest, int type) { }
+void receive(int type, message *msg) { }
+void receive_until(int type, message *msg, unsigned deadline) { }
+unsigned timer_micros(void) { return 0; }
+void badmesg(int type) { }
+void panic(char *fmt, ...) { }
+void __assert(char *file, int line, char *msg) { }
+
+#define WIDTH (END_COLUMN_ADDR+1)
+
+static byte ref[MAX_Y][WIDTH];  /* One byte per pixel */
+static byte before[RAM_PAGES][RAM_X_END];
+
+static long ncases = 0, nbad = 0;
+
+/* random -- simple generator, so the test is the same everywhere */
+static unsigned seed = 1;
+static unsigned random(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/* choose -- random integer in lo..hi */
+static int choose(int lo, int hi)
+{
+    return lo + random() % (hi - lo + 1);
+}
+
+/* ref_pixel -- draw one pixel of the reference, with clipping */
+static void ref_pixel(int x, int y, int mode)
+{
+    if (x < 0 || x >= WIDTH || y < 0 || y >= MAX_Y) return;
+
+    switch (mode) {
+    case PIXEL_OFF: ref[y][x] = 0; break;
+    case PIXEL_ON:  ref[y][x] = 1; break;
+    case PIXEL_XOR: ref[y][x] ^= 1; break;
+    }
+}
+
+/* ref_rect -- draw a rectangle of the reference */
+static void ref_rect(int x, int y, int w, int h, int mode)
+{
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++)
+            ref_pixel(x+j, y+i, mode);
+}
+
+/* ref_blit -- draw a bitmap on the reference */
+static void ref_blit(int x, int y, const byte *bmp, int w, int h, int mode)
+{
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++)
+            if (bmp[(i/8)*w + j] & (1 << (i%8)))
+                ref_pixel(x+j, y+i, mode);
+}
+
+/* randomize -- fill the screen and the reference with noise */
+static void randomize(void)
+{
+    for (int p = 0; p < RAM_PAGES; p++)
+        for (int x = 0; x < RAM_X_END; x++)
+            framebuf[p][x] = random();
+
+    for (int y = 0; y < MAX_Y; y++)
+        for (int x = 0; x < WIDTH; x++)
+            ref[y][x] = (framebuf[y/8][x] >> (y%8)) & 1;
+}
+
+/* prepare -- note the framebuffer before an operation */
+static void prepare(void)
+{
+    memcpy(before, framebuf, sizeof(before));
+    mark_clean();
+}
+
+/* check -- compare the framebuffer with the reference */
+static void check(const char *what, int x, int y, int w, int h, int mode)
+{
+    int bad = 0;
+
+    ncases++;
+
+    for (int y1 = 0; y1 < MAX_Y && !bad; y1++) {
+        for (int x1 = 0; x1 < WIDTH; x1++) {
+            if (((framebuf[y1/8][x1] >> (y1%8)) & 1) != ref[y1][x1]) {
+                bad = 1;
+                if (nbad < 10)
+                    printf("%s x=%d y=%d w=%d h=%d mode=%d: "
+                           "pixel (%d, %d) wrong\n",
+                           what, x, y, w, h, mode, x1, y1);
+                break;
+            }
+        }
+    }
+
+    /* Nothing outside the pages in use may change, and every change
+       must be marked dirty */
+    for (int p = 0; p < RAM_PAGES && !bad; p++) {
+        for (int x1 = 0; x1 < RAM_X_END; x1++) {
+            if (framebuf[p][x1] != before[p][x1]
+                && (p >= npages || x1 < dirty_lo[p] || x1 > dirty_hi[p])) {
+                bad = 1;
+                if (nbad < 10)
+                    printf("%s x=%d y=%d w=%d h=%d mode=%d: "
+                           "page %d column %d changed but not dirty\n",
+                           what, x, y, w, h, mode, p, x1);
+                break;
+            }
+        }
+    }
+
+    nbad += bad;
+}
+
+/* test_rect -- one rectangle */
+static void test_rect(int x, int y, int w, int h, int mode)
+{
+    prepare();
+    ssd1306_fill_rect(x, y, w, h, mode);
+    ref_rect(x, y, w, h, mode);
+    check("rect", x, y, w, h, mode);
+}
+
+/* test_blit -- one random bitmap */
+static void test_blit(int x, int y, int w, int h, int mode)
+{
+    byte bmp[WIDTH * (MAX_Y/8 + 1)];
+
+    for (int i = 0; i < w * ((h+7)/8); i++)
+        bmp[i] = random();
+
+    prepare();
+    ssd1306_blit(x, y, bmp, w, h, mode);
+    ref_blit(x, y, bmp, w, h, mode);
+    check("blit", x, y, w, h, mode);
+}
+
+int main(void)
+{
+    randomize();
+
+    /* Every start and end within a word, and every row span over two
+       pages, in each mode */
+    for (int mode = 0; mode < 3; mode++)
+        for (int x = 0; x < 8; x++)
+            for (int w = 0; w <= 13; w++)
+                for (int y = 0; y < 16; y++)
+                    for (int h = 0; h <= 17; h++)
+                        test_rect(x, y, w, h, mode);
+
+    /* Bitmaps at every shift, alignment and width, and over the
+       right and bottom edges */
+    for (int mode = 0; mode < 3; mode++)
+        for (int x = 0; x < 8; x++)
+            for (int w = 1; w <= 13; w++)
+                for (int y = 0; y < 16; y++)
+                    for (int h = 1; h <= 17; h++)
+                        test_blit(x, y, w, h, mode);
+
+    for (int y = MAX_Y-10; y < MAX_Y; y++)
+        for (int x = WIDTH-12; x < WIDTH; x++)
+            test_blit(x, y, 16, 16, PIXEL_ON);
+
+    /* Bitmaps partly above the top and left edges */
+    for (int y = -20; y < 0; y++)
+        for (int x = -12; x < 4; x++)
+            test_blit(x, y, 16, 24, PIXEL_XOR);
+
+    /* Random operations, often partly off the screen */
+    for (int i = 0; i < 100000; i++) {
+        int x = choose(-20, WIDTH+10), y = choose(-10, MAX_Y+10);
+        int w = choose(0, 70), h = choose(0, 40), mode = choose(0, 2);
+
+        switch (choose(0, 5)) {
+        case 0:
+            test_rect(x, y, w, h, mode);
+            break;
+        case 1:
+            prepare();
+            ssd1306_hline(x, y, w, mode);
+            ref_rect(x, y, w, 1, mode);
+            check("hline", x, y, w, 1, mode);
+            break;
+        case 2:
+            prepare();
+            ssd1306_vline(x, y, h, mode);
+            ref_rect(x, y, 1, h, mode);
+            check("vline", x, y, 1, h, mode);
+            break;
+        case 3:
+            prepare();
+            ssd1306_cursor(x, y, w, h);
+            ref_rect(x, y, w, h, PIXEL_XOR);
+            check("cursor", x, y, w, h, PIXEL_XOR);
+            break;
+        case 4:
+            prepare();
+            ssd1306_pixel(x, y, mode);
+            ref_pixel(x, y, mode);
+            check("pixel", x, y, 1, 1, mode);
+            break;
+        case 5:
+            test_blit(x, y, (w > 0 ? w : 1), (h > 0 ? h : 1), mode);
+            break;
+        }
+    }
+
+    printf("gfxtest: %ld cases, %ld failed\n", ncases, nbad);
+    return (nbad > 0);
+}
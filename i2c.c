@@ -4,6 +4,7 @@
 #include "microbian.h"
 #include "hardware.h"
 #include <stddef.h>
+#include <string.h>
 
 /* On the V1, there is only one I2C bus, but on the V2 there are
 separate buses for internal and external devices.  A client program
@@ -16,6 +17,14 @@ same code. */
 
 static int I2C_TASK[N_I2CS];
 
+/* Message type for a list of transactions */
+#define BATCH 16
+
+/* Flags for i2c_transfer when transactions are chained */
+#define I2C_RESTART 0x1         /* Start with a repeated start */
+#define I2C_NOSTOP 0x2          /* Leave the bus held at the end */
+
+#ifndef PI_PICO
 static const struct {
     unsigned scl;
     unsigned sda;
@@ -40,6 +49,10 @@ static const struct {
 
 #define I2C_REG(bus, reg) (* (i2c_pins[bus].base + OFFSET(reg)))
 
+/* Interrupts used in TWI mode */
+#define I2C_INTS (BIT(I2C_INT_RXDREADY) | BIT(I2C_INT_TXDSENT) \
+                  | BIT(I2C_INT_STOPPED) | BIT(I2C_INT_ERROR))
+
 /* i2c_wait -- wait for an expected interrupt event and detect error */
 static int i2c_wait(int bus, unsigned volatile *event)
 {
@@ -85,14 +98,10 @@ static void i2c_stop(int bus)
     i2c_wait(bus, &I2C_REG(bus, STOPPED));
 }
 
-/* i2c_task -- driver process for I2C hardware */
-static void i2c_task(int bus)
+/* i2c_setup -- configure pins and interface */
+static void i2c_setup(int bus)
 {
     unsigned scl = i2c_pins[bus].scl, sda = i2c_pins[bus].sda;
-    int irq = i2c_pins[bus].irq;
-    message m;
-    int client, addr, n1, n2, status, error = 0;
-    char *buf1, *buf2;
 
     /* Configure pins -- thanks to friends at University of Cantabria */
     gpio_drive(scl, GPIO_DRIVE_S0D1);
@@ -105,94 +114,530 @@ static void i2c_task(int bus)
     I2C_REG(bus, ENABLE) = I2C_ENABLE_Enabled;
 
     /* Enable interrupts */
-    I2C_REG(bus, INTEN) = BIT(I2C_INT_RXDREADY) | BIT(I2C_INT_TXDSENT)
-        | BIT(I2C_INT_STOPPED) | BIT(I2C_INT_ERROR);
-    connect(irq);
-    enable_irq(irq);
+    I2C_REG(bus, INTEN) = I2C_INTS;
+}
 
-    while (1) {
-        receive(ANY, &m);
-        client = m.sender;
-        addr = m.byte1;        /* Address [0..127] without R/W flag */
-        n1 = m.byte2;          /* Number of bytes in command */
-        n2 = m.byte3;          /* Number of bytes to transfer (R/W) */
-        buf1 = m.ptr2;        /* Buffer for command */
-        buf2 = m.ptr3;        /* Buffer for transfer */
+#ifdef UBIT_V2
+/* On the V2, the same interfaces can also run as TWIM, with EasyDMA:
+a long write, such as a frame for a display, goes out from a buffer in
+RAM without help from the processor, and the LASTTX_STOP shortcut ends
+it with a stop, so the only interrupt is STOPPED at the end.  EasyDMA
+cannot read from flash, where command lists are often kept, and needs
+the transaction in one piece, so the bytes are copied into a buffer of
+our own first.  As on the Pico, writes shorter than I2C_DMA_MIN are not
+worth switching modes for, and longer ones than I2C_DMA_MAX, like all
+reads, go byte by byte through the TWI. */
+
+#define I2C_DMA_MIN 16          /* Shortest write done by EasyDMA */
+#define I2C_DMA_MAX 1040        /* Longest: a 128x64 frame and commands */
+
+static byte *i2c_dmabuf[N_I2CS];
+
+/* i2c_dma_write -- write n1 bytes then n2 more by EasyDMA */
+static int i2c_dma_write(int bus, char *buf1, int n1, char *buf2, int n2,
+                         unsigned *error)
+{
+    byte *buf = i2c_dmabuf[bus];
+    int status;
+
+    if (buf == NULL)
+        buf = i2c_dmabuf[bus] = alloc(I2C_DMA_MAX);
+
+    memcpy(buf, buf1, n1);
+    memcpy(buf+n1, buf2, n2);
+
+    /* Change to TWIM mode for the transfer */
+    I2C_REG(bus, ENABLE) = I2C_ENABLE_Disabled;
+    I2C_REG(bus, ENABLE) = I2C_ENABLE_EnabledTWIM;
+    I2C_REG(bus, INTEN) = BIT(I2C_INT_STOPPED) | BIT(I2C_INT_ERROR);
+    I2C_REG(bus, TXD_PTR) = (unsigned) buf;
+    I2C_REG(bus, TXD_MAXCNT) = n1+n2;
+    I2C_REG(bus, SHORTS) = BIT(I2C_LASTTX_STOP);
+    I2C_REG(bus, STARTTX) = 1;
+
+    status = i2c_wait(bus, &I2C_REG(bus, STOPPED));
+
+    if (status != OK) {
+        /* After an error, the TWIM waits for a STOP task */
+        i2c_stop(bus);
+        *error = I2C_REG(bus, ERRORSRC);
+        I2C_REG(bus, ERRORSRC) = I2C_ERRORSRC_All;
+    }
 
-        switch (m.type) {
-        case READ:
-            I2C_REG(bus, ADDRESS) = addr;
-            status = OK;
-             
-            if (n1 > 0) {
-                /* Write followed by read, with repeated start */
-                I2C_REG(bus, STARTTX) = 1;
-                status = i2c_do_write(bus, buf1, n1);
-            }
+    I2C_REG(bus, SHORTS) = 0;
+    I2C_REG(bus, ENABLE) = I2C_ENABLE_Disabled;
+    I2C_REG(bus, ENABLE) = I2C_ENABLE_Enabled;
+    I2C_REG(bus, INTEN) = I2C_INTS;
+    return status;
+}
+#endif
+
+/* i2c_transfer -- carry out one transaction */
+static int i2c_transfer(int bus, i2c_op *op, int flags, unsigned *error)
+{
+    int n1 = op->n1, n2 = op->n2;
+    char *buf1 = (char *) op->buf1, *buf2 = (char *) op->buf2;
+    int status = OK;
+
+    /* Each transaction ends with a stop, so flags are ignored */
+
+    I2C_REG(bus, ADDRESS) = op->addr;
 
-            /* The hardware reference manual is wrong in several ways,
-               but the following code (based on timing diagrams in the
-               reference manual) works reliably. */
-
-            if (status == OK) {
-                for (int i = 0; i < n2; i++) {
-                    /* On all but the last byte, use SUSPEND to send
-                       an ACK after receiving the byte.  Use STOP to
-                       send a NACK at the end. */
-                    if (i < n2-1)
-                        I2C_REG(bus, SHORTS) = BIT(I2C_BB_SUSPEND);
-                    else
-                        I2C_REG(bus, SHORTS) = BIT(I2C_BB_STOP);
+    switch (op->kind) {
+    case READ:
+        if (n1 > 0) {
+            /* Write followed by read, with repeated start */
+            I2C_REG(bus, STARTTX) = 1;
+            status = i2c_do_write(bus, buf1, n1);
+        }
+
+        /* The hardware reference manual is wrong in several ways,
+           but the following code (based on timing diagrams in the
+           reference manual) works reliably. */
+
+        if (status == OK) {
+            for (int i = 0; i < n2; i++) {
+                /* On all but the last byte, use SUSPEND to send
+                   an ACK after receiving the byte.  Use STOP to
+                   send a NACK at the end. */
+                if (i < n2-1)
+                    I2C_REG(bus, SHORTS) = BIT(I2C_BB_SUSPEND);
+                else
+                    I2C_REG(bus, SHORTS) = BIT(I2C_BB_STOP);
         
-                    /* Start the first byte with STARTTX, and the rest
-                       with RESUME following the SUSPEND. */
-                    if (i == 0)
-                        I2C_REG(bus, STARTRX) = 1;
-                    else
-                        I2C_REG(bus, RESUME) = 1;
+                /* Start the first byte with STARTTX, and the rest
+                   with RESUME following the SUSPEND. */
+                if (i == 0)
+                    I2C_REG(bus, STARTRX) = 1;
+                else
+                    I2C_REG(bus, RESUME) = 1;
         
-                    status = i2c_wait(bus, &I2C_REG(bus, RXDREADY));
-                    if (status != OK) break;
-                    buf2[i] = I2C_REG(bus, RXD);
-                }
+                status = i2c_wait(bus, &I2C_REG(bus, RXDREADY));
+                if (status != OK) break;
+                buf2[i] = I2C_REG(bus, RXD);
             }
+        }
             
-            if (status == OK)
-                i2c_wait(bus, &I2C_REG(bus, STOPPED));
+        if (status == OK)
+            i2c_wait(bus, &I2C_REG(bus, STOPPED));
+
+        if (status != OK) {
+            i2c_stop(bus);
+            *error = I2C_REG(bus, ERRORSRC);
+            I2C_REG(bus, ERRORSRC) = I2C_ERRORSRC_All;
+        }
+
+        I2C_REG(bus, SHORTS) = 0;
+        return status;
+
+    case WRITE:
+#ifdef UBIT_V2
+        if (n1+n2 >= I2C_DMA_MIN && n1+n2 <= I2C_DMA_MAX)
+            return i2c_dma_write(bus, buf1, n1, buf2, n2, error);
+#endif
+
+        /* A single write transaction */
+        I2C_REG(bus, STARTTX) = 1;
+        if (n1 > 0)
+            status = i2c_do_write(bus, buf1, n1);
+        if (status == OK && n2 > 0)
+            status = i2c_do_write(bus, buf2, n2);
+        i2c_stop(bus);
+
+        if (status != OK) {
+            *error = I2C_REG(bus, ERRORSRC);
+            I2C_REG(bus, ERRORSRC) = I2C_ERRORSRC_All;
+        }
+
+        return status;
+
+    default:
+        return ERR;
+    }
+}
+
+#else
+
+/* On the Pico, both I2C interfaces are instances of the Synopsys
+DesignWare controller.  A transaction is described to it by a series
+of entries in a 16-deep command FIFO, each either a byte to write or a
+request to read a byte, and each optionally flagged to send a repeated
+start before it or a stop after it.  The driver keeps the FIFO topped
+up from the client's buffers, waking on TX_EMPTY when the FIFO falls
+below a threshold, collects received bytes on RX_FULL, and finishes on
+STOP_DET, so the processor is free while the bytes are shifted out.
+If the target fails to acknowledge, the controller flushes the FIFO,
+sends a stop and signals TX_ABRT, and the reply gives the reason. */
+
+#define I2C_FIFO 16             /* Depth of TX and RX FIFOs */
+#define I2C_FREQ 400000         /* Bus frequency in Hz, up to 1MHz */
+
+/* Each bus has its own driver process, and they run independently.
+The pins can be changed with i2c_config before the driver starts: SDA
+for I2C0 may be any of GPIO 0, 4, 8, ..., 28, and for I2C1 any of GPIO
+2, 6, 10, ..., 26, with SCL on the next pin in each case. */
+
+static struct {
+    unsigned scl;
+    unsigned sda;
+    int irq;
+    unsigned reset;
+    unsigned volatile *base;
+    int dma;                    /* DMA channel for long writes */
+    int dreq;                   /* DREQ signal for TX FIFO */
+} i2c_pins[N_I2CS] = {
+    { 21, 20, I2C0_IRQ, RESET_I2C0, I2C0_BASE, 0, DREQ_I2C0_TX },
+    { 3, 2, I2C1_IRQ, RESET_I2C1, I2C1_BASE, 1, DREQ_I2C1_TX }
+};
+
+/* i2c_config -- choose pins for a bus before starting its driver */
+void i2c_config(int bus, unsigned scl, unsigned sda)
+{
+    assert(I2C_TASK[bus] == 0);
+    assert(sda < 30 && scl == sda+1 && (sda/2) % 2 == bus);
+    i2c_pins[bus].scl = scl;
+    i2c_pins[bus].sda = sda;
+}
+
+/* Long writes, such as a whole frame for a display, are made by DMA
+from a buffer of command words into DATA_CMD, paced by the controller's
+TX DREQ.  The commands must be copied into the buffer first, because
+the bus fabric replicates a byte written to DATA_CMD into the command
+bits; but that is cheap beside the time taken on the bus.  The
+transfer then finishes with STOP_DET, so the only interrupt for the
+whole transaction is the one that ends it.  In a batch that holds the
+bus, the last command has no stop, and the transaction is finished
+once the DMA has queued it, as with the FIFO.  Writes shorter than
+I2C_DMA_MIN are not worth setting up the DMA for, and those longer than
+I2C_DMA_MAX go through the FIFO. */
+
+#define I2C_DMA_MIN 16          /* Shortest write done by DMA */
+#define I2C_DMA_MAX 1040        /* Longest: a 128x64 frame and commands */
+
+static unsigned short *i2c_dmabuf[N_I2CS];
+
+#define OFFSET(reg) (&I2C0_##reg - I2C0_BASE)
+
+/* i2ctest.c supplies its own I2C_REG, to simulate the controller */
+#ifndef I2C_REG
+#define I2C_REG(bus, reg) (* (i2c_pins[bus].base + OFFSET(reg)))
+#endif
+
+/* The target address can be changed only with the controller
+disabled, so we remember it and avoid doing so for each transfer. */
+static int i2c_target[N_I2CS];
+
+/* i2c_setup -- configure interface as a master at I2C_FREQ */
+static void i2c_setup(int bus)
+{
+    unsigned scl = i2c_pins[bus].scl, sda = i2c_pins[bus].sda;
+
+    /* SCL is low for 60% of each cycle, as the spec requires at
+       400kHz and above; SDA is held for 300ns after SCL falls, or
+       120ns in fast mode plus. */
+    unsigned period = (SYS_CLK_HZ + I2C_FREQ/2) / I2C_FREQ;
+    unsigned lcnt = period * 3 / 5, hcnt = period - lcnt;
+    unsigned hold = (I2C_FREQ < 1000000 ? SYS_CLK_HZ * 3 / 10000000 + 1
+                     : SYS_CLK_HZ * 3 / 25000000 + 1);
+
+    reset_subsystem(i2c_pins[bus].reset);
+
+    I2C_REG(bus, ENABLE) = 0;
+    I2C_REG(bus, CON) = BIT(I2C_CON_MASTER_MODE_ENABLED)
+        | FIELD(I2C_CON_SPEED, I2C_CON_SPEED_FAST)
+        | BIT(I2C_CON_RESTART_EN) | BIT(I2C_CON_SLAVE_DISABLE);
+    I2C_REG(bus, FS_SCL_HCNT) = hcnt;
+    I2C_REG(bus, FS_SCL_LCNT) = lcnt;
+    I2C_REG(bus, FS_SPKLEN) = (lcnt < 16 ? 1 : lcnt / 16);
+    SET_FIELD(I2C_REG(bus, SDA_HOLD), I2C_SDA_HOLD_TX, hold);
+
+    /* Refill the FIFO when a quarter full, so it does not run dry;
+       DMA keeps it at least half full */
+    I2C_REG(bus, TX_TL) = I2C_FIFO/4;
+    I2C_REG(bus, DMA_TDLR) = I2C_FIFO/2;
+    I2C_REG(bus, DMA_CR) = BIT(I2C_DMA_CR_TDMAE);
+    I2C_REG(bus, INTR_MASK) = 0;
+    i2c_target[bus] = -1;
+
+    gpio_set_func(scl, GPIO_FUNC_I2C);
+    gpio_set_func(sda, GPIO_FUNC_I2C);
+    gpio_pullup(scl);
+    gpio_pullup(sda);
+}
+
+/* i2c_wait -- wait for any of a set of events and return them all */
+static unsigned i2c_wait(int bus, unsigned mask)
+{
+    int irq = i2c_pins[bus].irq;
+    unsigned events;
+
+    /* The interrupt conditions are levels, so they are masked again
+       before the IRQ is re-enabled. */
+    I2C_REG(bus, INTR_MASK) = mask;
+    receive(INTERRUPT, NULL);
+    events = I2C_REG(bus, RAW_INTR_STAT);
+    I2C_REG(bus, INTR_MASK) = 0;
+    clear_pending(irq);
+    enable_irq(irq);
+    return events;
+}
+
+/* i2c_abort -- clean up after TX_ABRT and return the reason */
+static unsigned i2c_abort(int bus)
+{
+    /* The controller flushes the TX FIFO and sends a stop; it keeps
+       the FIFO flushed until the abort is cleared. */
+    unsigned error = I2C_REG(bus, TX_ABRT_SOURCE);
+    (void) I2C_REG(bus, CLR_TX_ABRT);
+    while (!(I2C_REG(bus, RAW_INTR_STAT) & BIT(I2C_INTR_STOP_DET)))
+        i2c_wait(bus, BIT(I2C_INTR_STOP_DET));
+    (void) I2C_REG(bus, CLR_STOP_DET);
+    while (I2C_REG(bus, RXFLR) > 0)
+        (void) I2C_REG(bus, DATA_CMD);
+    return error;
+}
+
+/* i2c_dma_write -- write n1 bytes then n2 more by DMA */
+static int i2c_dma_write(int bus, byte *buf1, int n1, byte *buf2, int n2,
+                         int flags, unsigned *error)
+{
+    int ch = i2c_pins[bus].dma;
+    unsigned short *cmd = i2c_dmabuf[bus];
+    int total = n1 + n2;
+    unsigned events;
+
+    if (cmd == NULL)
+        cmd = i2c_dmabuf[bus] = alloc(I2C_DMA_MAX * sizeof(short));
+
+    for (int i = 0; i < n1; i++)
+        cmd[i] = buf1[i];
+    for (int i = 0; i < n2; i++)
+        cmd[n1+i] = buf2[i];
+    if (flags & I2C_RESTART)
+        cmd[0] |= BIT(I2C_DATA_CMD_RESTART);
+    if (!(flags & I2C_NOSTOP))
+        cmd[total-1] |= BIT(I2C_DATA_CMD_STOP);
+
+    /* Chaining a channel to itself disables chaining */
+    DMA_CHAN(ch, READ_ADDR) = (unsigned) cmd;
+    DMA_CHAN(ch, WRITE_ADDR) = (unsigned) &I2C_REG(bus, DATA_CMD);
+    DMA_CHAN(ch, TRANS_COUNT) = total;
+    DMA_CHAN(ch, CTRL_TRIG) = BIT(DMA_CTRL_EN)
+        | FIELD(DMA_CTRL_DATA_SIZE, DMA_SIZE_HALFWORD)
+        | BIT(DMA_CTRL_INCR_READ)
+        | FIELD(DMA_CTRL_CHAIN_TO, ch)
+        | FIELD(DMA_CTRL_TREQ_SEL, i2c_pins[bus].dreq)
+        | BIT(DMA_CTRL_IRQ_QUIET);
+
+    if (flags & I2C_NOSTOP) {
+        /* With no stop to wait for, the transfer is done once the DMA
+           has put the last command in the FIFO.  TX_EMPTY wakes us
+           when the FIFO runs low, which it does only after that. */
+        do {
+            events = i2c_wait(bus, BIT(I2C_INTR_TX_ABRT)
+                              | BIT(I2C_INTR_TX_EMPTY));
+        } while (!(events & BIT(I2C_INTR_TX_ABRT))
+                 && (DMA_CHAN(ch, CTRL_TRIG) & BIT(DMA_CTRL_BUSY)));
+    } else {
+        events = i2c_wait(bus, BIT(I2C_INTR_TX_ABRT)
+                          | BIT(I2C_INTR_STOP_DET));
+    }
 
-            if (status != OK) {
-                i2c_stop(bus);
-                error = I2C_REG(bus, ERRORSRC);
-                I2C_REG(bus, ERRORSRC) = I2C_ERRORSRC_All;
+    if (events & BIT(I2C_INTR_TX_ABRT)) {
+        /* Stop the DMA before the abort is cleared, or it would
+           carry on filling the FIFO */
+        DMA_CHAN_ABORT = BIT(ch);
+        while (DMA_CHAN_ABORT & BIT(ch)) { /* wait */ }
+        *error = i2c_abort(bus);
+        return ERR;
+    }
+
+    if (!(flags & I2C_NOSTOP))
+        (void) I2C_REG(bus, CLR_STOP_DET);
+    return OK;
+}
+
+/* A transaction in a batch that is followed by another for the same
+device is run with the flag I2C_NOSTOP, so that it leaves the bus held,
+and the next one with I2C_RESTART, so that it begins with a repeated
+start.  A transaction without a stop is finished as soon as its last
+command is in the FIFO and any bytes it reads have arrived, and the
+next one can be queued behind it straight away.  An abort detected
+then is blamed on the later transaction, but either way the batch
+fails. */
+
+/* i2c_transfer -- write n1 bytes, then read or write n2 more */
+static int i2c_transfer(int bus, i2c_op *op, int flags, unsigned *error)
+{
+    int kind = op->kind, n1 = op->n1, n2 = op->n2;
+    byte *buf1 = op->buf1, *buf2 = op->buf2;
+    int total = n1 + n2;        /* Number of commands to queue */
+    int nread = (kind == READ ? n2 : 0);
+    int sent = 0, got = 0;      /* Commands queued, bytes received */
+    int waiting;                /* Reads queued but not received */
+    unsigned mask, events;
+
+    /* As with the nRF, there is no way to send just an address */
+    if (total == 0) return ERR;
+
+    if (!(flags & I2C_RESTART)) {
+        if (op->addr != i2c_target[bus]) {
+            I2C_REG(bus, ENABLE) = 0;
+            I2C_REG(bus, TAR) = op->addr;
+            I2C_REG(bus, ENABLE) = 1;
+            i2c_target[bus] = op->addr;
+        }
+
+        (void) I2C_REG(bus, CLR_INTR);
+    }
+
+    if (kind == WRITE && total >= I2C_DMA_MIN && total <= I2C_DMA_MAX)
+        return i2c_dma_write(bus, buf1, n1, buf2, n2, flags, error);
+
+    while (1) {
+        /* Queue commands while there is space, not letting reads
+           outrun the space in the RX FIFO */
+        while (sent < total && I2C_REG(bus, TXFLR) < I2C_FIFO
+               && (kind == WRITE || sent < n1
+                   || sent - n1 - got < I2C_FIFO)) {
+            unsigned cmd;
+
+            if (sent < n1)
+                cmd = buf1[sent];
+            else if (kind == WRITE)
+                cmd = buf2[sent-n1];
+            else {
+                cmd = BIT(I2C_DATA_CMD_CMD);
+                if (sent == n1 && n1 > 0)
+                    cmd |= BIT(I2C_DATA_CMD_RESTART);
             }
 
-            I2C_REG(bus, SHORTS) = 0;
+            if (sent == 0 && (flags & I2C_RESTART))
+                cmd |= BIT(I2C_DATA_CMD_RESTART);
+            if (sent == total-1 && !(flags & I2C_NOSTOP))
+                cmd |= BIT(I2C_DATA_CMD_STOP);
+
+            I2C_REG(bus, DATA_CMD) = cmd;
+            sent++;
+        }
+
+        waiting = (nread > 0 && sent > n1 ? sent - n1 - got : 0);
+
+        if ((flags & I2C_NOSTOP) && sent == total && waiting == 0)
+            return OK;
+
+        /* If reads are held up for lack of space, it's RX_FULL that
+           will let us continue, and TX_EMPTY may be set already. */
+        mask = BIT(I2C_INTR_TX_ABRT) | BIT(I2C_INTR_STOP_DET);
+        if (sent < total && waiting < I2C_FIFO)
+            mask |= BIT(I2C_INTR_TX_EMPTY);
+
+        if (waiting > 0) {
+            /* Wake when half the FIFO or all the bytes have arrived */
+            if (waiting > I2C_FIFO/2) waiting = I2C_FIFO/2;
+            I2C_REG(bus, RX_TL) = waiting-1;
+            mask |= BIT(I2C_INTR_RX_FULL);
+        }
+
+        events = i2c_wait(bus, mask);
+
+        while (got < nread && I2C_REG(bus, RXFLR) > 0)
+            buf2[got++] = I2C_REG(bus, DATA_CMD) & 0xff;
+
+        if (events & BIT(I2C_INTR_TX_ABRT)) {
+            *error = i2c_abort(bus);
+            return ERR;
+        }
+
+        if (events & BIT(I2C_INTR_STOP_DET)) {
+            (void) I2C_REG(bus, CLR_STOP_DET);
+            return (sent == total && got == nread ? OK : ERR);
+        }
+    }
+}
+
+#endif
+
+/* A BATCH message carries a list of transactions in ptr1 and their
+number in int2.  They are run in order until one fails, and the reply
+gives the status, the error code, and in int3 the number that
+succeeded. */
+
+/* i2c_batch_run -- carry out a list of transactions */
+static int i2c_batch_run(int bus, i2c_op *ops, int n,
+                         int *done, unsigned *error)
+{
+    int flags = 0, status;
+
+    /* Check first, so as not to leave the bus held by a failure */
+    for (int i = 0; i < n; i++) {
+        if (ops[i].n1 + ops[i].n2 == 0) {
+            *done = 0;
+            return ERR;
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        /* Hold the bus if the next transaction is for the same device */
+        if (i+1 < n && ops[i+1].addr == ops[i].addr)
+            flags |= I2C_NOSTOP;
+        else
+            flags &= ~I2C_NOSTOP;
+
+        status = i2c_transfer(bus, &ops[i], flags, error);
+        if (status != OK) {
+            *done = i;
+            return status;
+        }
+
+        flags = (flags & I2C_NOSTOP ? I2C_RESTART : 0);
+    }
+
+    *done = n;
+    return OK;
+}
+
+/* i2c_task -- driver process for I2C hardware */
+static void i2c_task(int bus)
+{
+    int irq = i2c_pins[bus].irq;
+    message m;
+    int client, status, done;
+    unsigned error;
+    i2c_op op;
+
+    i2c_setup(bus);
+    connect(irq);
+    enable_irq(irq);
+
+    while (1) {
+        receive(ANY, &m);
+        client = m.sender;
+        error = 0;
+
+        switch (m.type) {
+        case READ:
+        case WRITE:
+            op.kind = m.type;
+            op.addr = m.byte1;  /* Address [0..127] without R/W flag */
+            op.n1 = m.byte2;    /* Number of bytes in command */
+            op.n2 = m.byte3 | (m.byte4 << 8); /* Bytes to read or write */
+            op.buf1 = m.ptr2;   /* Buffer for command */
+            op.buf2 = m.ptr3;   /* Buffer for transfer */
+
+            status = i2c_transfer(bus, &op, 0, &error);
             m.type = REPLY;
             m.int1 = status;
             m.int2 = error;
             send(client, &m);
             break;
 
-        case WRITE:
-            I2C_REG(bus, ADDRESS) = addr;
-            status = OK;
-
-            /* A single write transaction */
-            I2C_REG(bus, STARTTX) = 1;
-            if (n1 > 0)
-                status = i2c_do_write(bus, buf1, n1);
-            if (status == OK && n2 > 0)
-                status = i2c_do_write(bus, buf2, n2);
-            i2c_stop(bus);
-
-            if (status != OK) {
-                error = I2C_REG(bus, ERRORSRC);
-                I2C_REG(bus, ERRORSRC) = I2C_ERRORSRC_All;
-            }
-               
+        case BATCH:
+            status = i2c_batch_run(bus, m.ptr1, m.int2, &done, &error);
             m.type = REPLY;
             m.int1 = status;
             m.int2 = error;
+            m.int3 = done;
             send(client, &m);
             break;
 
@@ -218,13 +663,37 @@ int i2c_xfer(int bus, int kind, int addr,
     m.type = kind;
     m.byte1 = addr;
     m.byte2 = n1;
-    m.byte3 = n2;
+    m.byte3 = n2 & 0xff;        /* Up to 65535 bytes */
+    m.byte4 = n2 >> 8;
     m.ptr2 = buf1;
     m.ptr3 = buf2;
     sendrec(I2C_TASK[bus], &m);
     return m.int1;
 }
 
+/* i2c_batch -- run a list of transactions with one message */
+int i2c_batch(int bus, i2c_op *ops, int n)
+{
+    message m;
+    m.type = BATCH;
+    m.ptr1 = ops;
+    m.int2 = n;
+    sendrec(I2C_TASK[bus], &m);
+    return m.int1;
+}
+
+/* i2c_batch_start -- begin a list of transactions without waiting */
+void i2c_batch_start(int bus, i2c_op *ops, int n)
+{
+    /* The caller must receive the REPLY, and leave the list and
+       buffers alone until it does. */
+    message m;
+    m.type = BATCH;
+    m.ptr1 = ops;
+    m.int2 = n;
+    send(I2C_TASK[bus], &m);
+}
+
 /* i2c_probe -- try to access an I2C device */
 int i2c_probe(int bus, int addr)
 {
@@ -243,7 +712,7 @@ void i2c_read_bytes(int bus, int addr, int cmd, byte *buf2, int n2)
 /* i2c_read_reg -- send command and read one byte */
 int i2c_read_reg(int bus, int addr, int cmd)
 {
-    byte buf;
+    byte buf = 0;
     i2c_read_bytes(bus, addr, cmd, &buf, 1);
     return buf;
 }
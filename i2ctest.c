@@ -0,0 +1,497 @@
+/* i2ctest.c */
+
+/* Host test of the Pico I2C driver in i2c.c.  The driver's register
+accesses go through sim_reg, which models enough of the DesignWare
+controller for the driver: a 16-entry command FIFO, the RX FIFO with
+the bus stalled while it is full, repeated starts, stops, a target that
+does not acknowledge, and the interrupt conditions.  The DMA channel
+registers and the NVIC are plain memory mapped at their real
+addresses, and the simulated DMA feeds the command FIFO from them.
+
+The bus moves only while the driver is waiting in receive, a byte at a
+time, until an interrupt it has asked for becomes due.  Every start,
+byte and stop goes into a log, which is compared with what the
+transaction should have put on the bus.  If the driver waits for
+something that can never happen, or keeps waking without doing
+anything, the test says so instead of hanging.
+
+Build with "make i2ctest", which uses the system cc. */
+
+#define I2C_REG(bus, reg) (*sim_reg(bus, OFFSET(reg)))
+
+static unsigned volatile *sim_reg(int bus, int off);
+
+#include "i2c.c"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+
+#define NREGS 64                /* Words in the register block */
+#define MARK 0x80000000         /* Never written to DATA_CMD */
+#define REG(r) regs[OFFSET(r)]
+
+static unsigned regs[NREGS];
+static int last_reg = -1;       /* Register given out by sim_reg */
+
+static unsigned txq[I2C_FIFO];  /* Command FIFO */
+static int txn = 0;
+static unsigned rxq[I2C_FIFO];  /* Received bytes */
+static int rxn = 0;
+
+static int stop_det = 0, abrt = 0;
+static int active = 0, reading = 0; /* Bus held, and in which direction */
+static int nack_addr = -1;      /* Target that does not respond */
+static unsigned next_byte = 0;  /* Next byte the target sends */
+
+static char buslog[20000];      /* Everything that went on the bus */
+static int progress = 0;        /* Changes since the driver last waited */
+static int idle = 0;            /* Wakeups in a row without progress */
+static int overflow = 0;        /* Writes to a full FIFO */
+static jmp_buf stuck;
+
+#define DMA_CH 0                /* Channel used for I2C0 */
+
+/* buslogf -- add to the bus log */
+static void buslogf(const char *fmt, unsigned x)
+{
+    int n = strlen(buslog);
+    snprintf(buslog+n, sizeof(buslog)-n, fmt, x);
+}
+
+/* push -- add a command to the FIFO, unless it is being flushed */
+static void push(unsigned cmd)
+{
+    if (abrt) return;
+    if (txn == I2C_FIFO) {
+        overflow++;
+        return;
+    }
+    txq[txn++] = cmd;
+    progress++;
+}
+
+/* commit -- deal with the driver's last register access */
+static void commit(void)
+{
+    if (last_reg == OFFSET(DATA_CMD)) {
+        unsigned v = REG(DATA_CMD);
+
+        if (!(v & MARK))
+            push(v);
+        else if (rxn > 0) {
+            /* It was a read */
+            rxn--;
+            memmove(rxq, rxq+1, rxn * sizeof(unsigned));
+            progress++;
+        }
+    }
+
+    last_reg = -1;
+}
+
+/* status -- raw interrupt status */
+static unsigned status(void)
+{
+    unsigned s = 0;
+
+    if (txn <= REG(TX_TL)) s |= BIT(I2C_INTR_TX_EMPTY);
+    if (rxn > REG(RX_TL)) s |= BIT(I2C_INTR_RX_FULL);
+    if (stop_det) s |= BIT(I2C_INTR_STOP_DET);
+    if (abrt) s |= BIT(I2C_INTR_TX_ABRT);
+    return s;
+}
+
+static unsigned volatile *sim_reg(int bus, int off)
+{
+    if (bus != 0) {
+        printf("bus %d used\n", bus);
+        longjmp(stuck, 1);
+    }
+
+    commit();
+
+    if (off == OFFSET(TXFLR))
+        regs[off] = txn;
+    else if (off == OFFSET(RXFLR))
+        regs[off] = rxn;
+    else if (off == OFFSET(RAW_INTR_STAT))
+        regs[off] = status();
+    else if (off == OFFSET(DATA_CMD))
+        regs[off] = MARK | (rxn > 0 ? rxq[0] : 0);
+    else if (off == OFFSET(CLR_STOP_DET))
+        stop_det = 0;
+    else if (off == OFFSET(CLR_TX_ABRT))
+        abrt = 0;
+    else if (off == OFFSET(CLR_INTR))
+        stop_det = abrt = 0;
+
+    last_reg = off;
+    return &regs[off];
+}
+
+/* dma_run -- let the DMA top up the FIFO */
+static void dma_run(void)
+{
+    unsigned volatile *ctrl = &DMA_CHAN(DMA_CH, CTRL_TRIG);
+
+    if ((*ctrl & BIT(DMA_CTRL_EN)) && (REG(DMA_CR) & BIT(I2C_DMA_CR_TDMAE))
+        && DMA_CHAN(DMA_CH, TRANS_COUNT) > 0 && txn <= REG(DMA_TDLR)) {
+        while (txn < I2C_FIFO && DMA_CHAN(DMA_CH, TRANS_COUNT) > 0) {
+            unsigned addr = DMA_CHAN(DMA_CH, READ_ADDR);
+            push(* (unsigned short *) (uintptr_t) addr);
+            DMA_CHAN(DMA_CH, READ_ADDR) = addr + 2;
+            DMA_CHAN(DMA_CH, TRANS_COUNT)--;
+        }
+    }
+
+    if ((*ctrl & BIT(DMA_CTRL_EN)) && DMA_CHAN(DMA_CH, TRANS_COUNT) > 0)
+        *ctrl |= BIT(DMA_CTRL_BUSY);
+    else
+        *ctrl &= ~BIT(DMA_CTRL_BUSY);
+}
+
+/* step -- carry out one command from the FIFO, if possible */
+static int step(void)
+{
+    unsigned cmd;
+    int rd;
+
+    if (txn == 0) return 0;
+    cmd = txq[0];
+    rd = ((cmd & BIT(I2C_DATA_CMD_CMD)) != 0);
+    if (rd && rxn == I2C_FIFO) return 0; /* SCL is held low */
+
+    txn--;
+    memmove(txq, txq+1, txn * sizeof(unsigned));
+    progress++;
+
+    if (!active || (cmd & BIT(I2C_DATA_CMD_RESTART)) || rd != reading) {
+        buslogf(active ? " Sr%02x" : " S%02x", REG(TAR));
+        buslogf(rd ? "R" : "W", 0);
+
+        if (REG(TAR) == nack_addr) {
+            /* Flush the FIFO and send a stop */
+            buslogf(" P", 0);
+            abrt = 1;
+            REG(TX_ABRT_SOURCE) = 1;
+            txn = 0;
+            active = 0;
+            stop_det = 1;
+            return 1;
+        }
+
+        active = 1;
+        reading = rd;
+    }
+
+    if (rd) {
+        rxq[rxn++] = next_byte++ & 0xff;
+        buslogf(" r", 0);
+    } else {
+        buslogf(" %02x", cmd & 0xff);
+    }
+
+    if (cmd & BIT(I2C_DATA_CMD_STOP)) {
+        buslogf(" P", 0);
+        active = 0;
+        stop_det = 1;
+    }
+
+    return 1;
+}
+
+/* receive -- the driver waits here for an interrupt */
+void receive(int type, message *msg)
+{
+    unsigned mask;
+
+    commit();
+    mask = REG(INTR_MASK);
+
+    if (progress == 0) {
+        if (++idle > 1000) {
+            printf("livelock: driver wakes with mask %#x and does nothing\n",
+                   mask);
+            longjmp(stuck, 1);
+        }
+    } else {
+        idle = 0;
+    }
+    progress = 0;
+
+    while (1) {
+        dma_run();
+        if (status() & mask) return;
+        if (!step()) {
+            printf("deadlock: driver waits for %#x, status %#x\n",
+                   mask, status());
+            longjmp(stuck, 1);
+        }
+    }
+}
+
+/* Stubs for the rest of micro:bian */
+static unsigned short dmabuf[I2C_DMA_MAX];
+void *alloc(int size) { return dmabuf; }
+void enable_irq(int irq) { }
+void connect(int irq) { }
+void send(int dest, message *msg) { }
+void sendrec(int dest, message *msg) { }
+int start(char *name, void (*body)(int), int arg, int stksize) { return 1; }
+void badmesg(int type) { }
+void panic(char *fmt, ...) { }
+void yield(void) { }
+void __assert(char *file, int line, char *msg) { }
+
+
+static int ntests = 0, nfailed = 0;
+
+static char want[20000];        /* Expected bus log */
+
+/* wantf -- add to the expected log */
+static void wantf(const char *fmt, unsigned x)
+{
+    int n = strlen(want);
+    snprintf(want+n, sizeof(want)-n, fmt, x);
+}
+
+/* want_write -- expect a write of n bytes from buf, after a start, a
+   repeated start, or neither if restart < 0 */
+static void want_write(int addr, int restart, byte *buf, int n)
+{
+    if (restart >= 0) wantf(restart ? " Sr%02xW" : " S%02xW", addr);
+    for (int i = 0; i < n; i++) wantf(" %02x", buf[i]);
+}
+
+/* want_read -- expect a read of n bytes */
+static void want_read(int addr, int restart, int n)
+{
+    wantf(restart ? " Sr%02xR" : " S%02xR", addr);
+    for (int i = 0; i < n; i++) wantf(" r", 0);
+}
+
+/* reset -- start a test with an idle bus */
+static void reset(void)
+{
+    memset(regs, 0, sizeof(regs));
+    last_reg = -1;
+    txn = rxn = 0;
+    stop_det = abrt = active = 0;
+    progress = idle = overflow = 0;
+    next_byte = 0xa0;
+    buslog[0] = want[0] = '\0';
+    memset((void *) &DMA_CHAN(DMA_CH, READ_ADDR), 0, 64);
+
+    /* As set by i2c_setup */
+    REG(TX_TL) = I2C_FIFO/4;
+    REG(DMA_TDLR) = I2C_FIFO/2;
+    REG(DMA_CR) = BIT(I2C_DMA_CR_TDMAE);
+    i2c_target[0] = -1;
+}
+
+/* finish -- check the outcome of a test */
+static void finish(const char *name, int n, int ok)
+{
+    commit();
+    ntests++;
+
+    if (txn > 0 || active || overflow)
+        ok = 0;
+    if (ok && strcmp(buslog, want) == 0)
+        return;
+
+    if (nfailed++ < 10) {
+        printf("%s %d failed%s\n", name, n,
+               (overflow ? " (FIFO overflow)" : ""));
+        printf("  bus:  %.200s\n", buslog);
+        printf("  want: %.200s\n", want);
+    }
+}
+
+static byte data[2000];
+static byte cmd[1] = { 0x40 };
+
+/* test_write -- single write of 1+n bytes */
+static void test_write(int n)
+{
+    i2c_op op = { WRITE, 0x3c, cmd, 1, data, n };
+    unsigned error = 0;
+    int status;
+
+    reset();
+    if (setjmp(stuck)) {
+        finish("write", n, 0);
+        return;
+    }
+
+    status = i2c_transfer(0, &op, 0, &error);
+    want_write(0x3c, 0, cmd, 1);
+    want_write(0x3c, -1, data, n);
+    wantf(" P", 0);
+    finish("write", n, status == OK);
+}
+
+/* test_read -- write a register number, then read n bytes */
+static void test_read(int n1, int n)
+{
+    byte buf[200];
+    i2c_op op = { READ, 0x1d, cmd, n1, buf, n };
+    unsigned error = 0;
+    int status, ok;
+
+    reset();
+    if (setjmp(stuck)) {
+        finish("read", n, 0);
+        return;
+    }
+
+    status = i2c_transfer(0, &op, 0, &error);
+    if (n1 > 0) want_write(0x1d, 0, cmd, n1);
+    want_read(0x1d, n1 > 0, n);
+    wantf(" P", 0);
+
+    ok = (status == OK);
+    for (int i = 0; i < n; i++)
+        if (buf[i] != ((0xa0 + i) & 0xff)) ok = 0;
+    finish("read", n, ok);
+}
+
+/* test_batch -- several transactions, most to the same device */
+static void test_batch(int n)
+{
+    byte buf[100];
+    i2c_op ops[] = {
+        { WRITE, 0x3c, cmd, 1, data, n },
+        { WRITE, 0x3c, cmd, 1, data+1, n+10 },
+        { WRITE, 0x3c, cmd, 1, data, 3 },
+        { READ, 0x3c, cmd, 1, buf, 20 },
+        { WRITE, 0x50, cmd, 1, data+2, n }
+    };
+    unsigned error = 0;
+    int status, done;
+
+    reset();
+    if (setjmp(stuck)) {
+        finish("batch", n, 0);
+        return;
+    }
+
+    status = i2c_batch_run(0, ops, 5, &done, &error);
+    want_write(0x3c, 0, cmd, 1);
+    want_write(0x3c, -1, data, n);
+    want_write(0x3c, 1, cmd, 1);
+    want_write(0x3c, -1, data+1, n+10);
+    want_write(0x3c, 1, cmd, 1);
+    want_write(0x3c, -1, data, 3);
+    want_write(0x3c, 1, cmd, 1);
+    want_read(0x3c, 1, 20);
+    wantf(" P", 0);
+    want_write(0x50, 0, cmd, 1);
+    want_write(0x50, -1, data+2, n);
+    wantf(" P", 0);
+    finish("batch", n, status == OK && done == 5);
+}
+
+/* test_flush -- a batch like a display flush: for each of n pages,
+   a few commands and a row of data, all for the same device */
+static void test_flush(int n, int width)
+{
+    static byte cmds[8][6];
+    i2c_op ops[16];
+    unsigned error = 0;
+    int status, done;
+
+    reset();
+    if (setjmp(stuck)) {
+        finish("flush", width, 0);
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < 6; j++) cmds[i][j] = 0x20 + i + j;
+        ops[2*i] = (i2c_op) { WRITE, 0x3c, cmd, 1, cmds[i], 6 };
+        ops[2*i+1] = (i2c_op) { WRITE, 0x3c, cmd, 1, data + i, width };
+    }
+
+    status = i2c_batch_run(0, ops, 2*n, &done, &error);
+    for (int i = 0; i < n; i++) {
+        want_write(0x3c, i > 0, cmd, 1);
+        want_write(0x3c, -1, cmds[i], 6);
+        want_write(0x3c, 1, cmd, 1);
+        want_write(0x3c, -1, data + i, width);
+    }
+    wantf(" P", 0);
+    finish("flush", width, status == OK && done == 2*n);
+}
+
+/* test_nack -- a write to an absent device, then one that works */
+static void test_nack(int n)
+{
+    i2c_op op = { WRITE, 0x3d, cmd, 1, data, n };
+    unsigned error = 0;
+    int status;
+
+    reset();
+    nack_addr = 0x3d;
+    if (setjmp(stuck)) {
+        nack_addr = -1;
+        finish("nack", n, 0);
+        return;
+    }
+
+    status = i2c_transfer(0, &op, 0, &error);
+    wantf(" S3dW P", 0);
+    if (status != ERR || error == 0) {
+        nack_addr = -1;
+        finish("nack", n, 0);
+        return;
+    }
+
+    op.addr = 0x3c;
+    status = i2c_transfer(0, &op, 0, &error);
+    want_write(0x3c, 0, cmd, 1);
+    want_write(0x3c, -1, data, n);
+    wantf(" P", 0);
+    nack_addr = -1;
+    finish("nack", n, status == OK);
+}
+
+int main(void)
+{
+    /* Memory where the DMA registers and the NVIC are */
+    if (mmap((void *) 0x50000000, 0x1000, PROT_READ|PROT_WRITE,
+             MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED
+        || mmap((void *) 0xe000e000, 0x1000, PROT_READ|PROT_WRITE,
+                MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED) {
+        perror("mmap");
+        return 2;
+    }
+
+    for (int i = 0; i < sizeof(data); i++)
+        data[i] = i * 7 + 3;
+
+    /* Both sides of I2C_DMA_MIN and I2C_DMA_MAX */
+    for (int n = 0; n <= 100; n++) test_write(n);
+    for (int n = I2C_DMA_MAX-3; n <= I2C_DMA_MAX+3; n++) test_write(n);
+    test_write(1500);
+
+    for (int n = 1; n <= 100; n++) {
+        test_read(1, n);
+        test_read(0, n);
+    }
+
+    for (int n = 0; n <= 200; n += 5) test_batch(n);
+    test_batch(1200);
+
+    for (int w = 1; w <= 128; w++) test_flush(4, w);
+    test_flush(8, 128);
+
+    test_nack(2);
+    test_nack(14);
+
+    printf("i2ctest: %d tests, %d failed\n", ntests, nfailed);
+    return (nfailed > 0);
+}
@@ -6,16 +6,45 @@
 
 #define NMAX 16                 // Max digits in a printed number
 
+/* The Cortex-M0 has no divide instruction, so x / 10 and x % 10 would
+each be a call to a slow library routine.  Instead, we multiply by an
+approximation to 1/10 using shifts and adds, then correct the result
+using the remainder, which is never more than one step out.  Hex
+conversion needs only shifts and masks. */
+
+/* divu10 -- divide by 10, returning quotient and setting remainder */
+static inline unsigned divu10(unsigned x, unsigned *rem) {
+    unsigned q = (x >> 1) + (x >> 2);   // q = 0.75 x
+    q += q >> 4;                        // 0.796875 x
+    q += q >> 8;
+    q += q >> 16;                       // 0.79999999 x
+    q >>= 3;                            // 0.1 x, perhaps one too small
+    unsigned r = x - ((q << 3) + (q << 1));
+    if (r > 9) {
+        q++; r -= 10;
+    }
+    *rem = r;
+    return q;
+}
+
 /* utoa -- convert unsigned to decimal or hex */
 static char *utoa(unsigned x, unsigned base, char *nbuf) {
     char *p = &nbuf[NMAX];
     const char *hex = "0123456789abcdef";
+    unsigned r;
 
     *--p = '\0';
-    do {
-        *--p = hex[x % base];
-        x = x / base;
-    } while (x != 0);
+    if (base == 16) {
+        do {
+            *--p = hex[x & 0xf];
+            x >>= 4;
+        } while (x != 0);
+    } else {
+        do {
+            x = divu10(x, &r);
+            *--p = '0' + r;
+        } while (x != 0);
+    }
      
     return p;
 }
@@ -25,7 +54,7 @@ static char *itoa(int v, char *nbuf) {
     if (v >= 0)
         return utoa(v, 10, nbuf);
     else {
-        char *p = utoa(-v, 10, nbuf);
+        char *p = utoa(- (unsigned) v, 10, nbuf);
         *--p = '-';
         return p;
     }
@@ -90,35 +119,81 @@ static void do_string(void (*putc)(void *, char), void *q, char *str) {
         putc(q, *p);
 }
 
+/* Conversions may have a field width, with a '-' flag to pad on the
+right or a '0' flag to pad with zeroes, as in "%5d" or "%08x".  For
+compatibility, %x still puts 0x in front of a non-zero number, and the
+width includes it, as with %#x in standard C: zero padding goes
+between the 0x and the digits. */
+
+/* do_field -- output a prefix and string padded to a width */
+static void do_field(void (*putc)(void *, char), void *q,
+                     char *pfx, char *str, int width, char flag) {
+    int w = width;
+    char *p;
+
+    for (p = pfx; *p != '\0'; p++) w--;
+    for (p = str; *p != '\0'; p++) w--;
+
+    if (flag == '0') {
+        do_string(putc, q, pfx);
+        for (; w > 0; w--) putc(q, '0');
+        do_string(putc, q, str);
+        return;
+    }
+
+    if (flag != '-')
+        for (; w > 0; w--) putc(q, ' ');
+    do_string(putc, q, pfx);
+    do_string(putc, q, str);
+    for (; w > 0; w--) putc(q, ' ');
+}
+
 /* _do_print -- the guts of printf */
 void _do_print(void (*putc)(void *, char), void *q,
                const char *fmt, va_list va) {
-    int x;
+    unsigned x;
+    int width;
+    char flag, *s;
     char nbuf[NMAX];
 
     for (const char *p = fmt; *p != 0; p++) {
         if (*p == '%' && *(p+1) != '\0') {
-            switch (*++p) {
+            p++;
+            flag = '\0';
+            if (*p == '-' || *p == '0') flag = *p++;
+            width = 0;
+            while (*p >= '0' && *p <= '9')
+                width = 10 * width + (*p++ - '0');
+            if (*p == '\0') break;
+
+            switch (*p) {
             case 'c':
+                /* Output the character itself, so that even a NUL
+                   gets through, with any padding around it */
+                if (flag != '-')
+                    for (; width > 1; width--) putc(q, ' ');
                 putc(q, va_arg(va, int));
+                for (; width > 1; width--) putc(q, ' ');
                 break;
             case 'd':
-                do_string(putc, q, itoa(va_arg(va, int), nbuf));
+                s = itoa(va_arg(va, int), nbuf);
+                if (*s == '-')
+                    do_field(putc, q, "-", s+1, width, flag);
+                else
+                    do_field(putc, q, "", s, width, flag);
                 break;
             case 's':
-                do_string(putc, q, va_arg(va, char *));
+                s = va_arg(va, char *);
+                do_field(putc, q, "", s, width, (flag == '0' ? 0 : flag));
                 break;
             case 'u':
-                do_string(putc, q, utoa(va_arg(va, unsigned), 10, nbuf));
+                s = utoa(va_arg(va, unsigned), 10, nbuf);
+                do_field(putc, q, "", s, width, flag);
                 break;
             case 'x':
                 x = va_arg(va, unsigned);
-                if (x == 0)
-                    putc(q, '0');
-                else {
-                    putc(q, '0'); putc(q, 'x');
-                    do_string(putc, q, utoa(x, 16, nbuf));
-                }
+                do_field(putc, q, (x == 0 ? "" : "0x"),
+                         utoa(x, 16, nbuf), width, flag);
                 break;
             default:
                 putc(q, *p);
@@ -168,6 +243,23 @@ repeated calls to serial_putc. */
 /* print_buf -- must be provided by client */
 extern void print_buf(char *buf, int n);
 
+/* print_state -- two slots for the current process: its buffer, and
+   the output function chosen by print_redirect.  micro:bian provides a
+   pair per process; this default is for other clients. */
+__attribute((weak)) void **print_state(void) {
+    static void *state[2] = { NULL, NULL };
+    return state;
+}
+
+#define PS_STREAM 0
+#define PS_OUT 1
+
+/* print_out -- the current process's output function */
+static void (*print_out(void))(char *buf, int n) {
+    void *out = print_state()[PS_OUT];
+    return (out != NULL ? (void (*)(char *, int)) out : print_buf);
+}
+
 #define NBUF 16
 
 /* struct buffer -- buffer for use by printf */
@@ -178,7 +270,7 @@ struct buffer {
     
 /* flush -- flush a buffer by calling print_buf */
 static void flush(struct buffer *b) {
-    print_buf(b->buf, b->nbuf);
+    (*print_out())(b->buf, b->nbuf);
     b->nbuf = 0;
 }
 
@@ -189,15 +281,91 @@ static void f_bufferc(void *q, char c) {
     b->buf[b->nbuf++] = c;
 }
 
+/* Production programs that print a lot can instead give each process
+a buffer of its own with print_setbuf, so that a whole line or record
+goes to print_buf in one go.  The buffer persists between calls of
+printf, and the mode says when it is flushed, as with setvbuf in
+stdio.  A few bytes at the start of the buffer are used for the
+bookkeeping.  Processes that never call print_setbuf keep the
+behaviour described above. */
+
+/* struct stream -- per-process buffer set up by print_setbuf */
+struct stream {
+    int mode;                   /* BUF_NONE, BUF_LINE or BUF_FULL */
+    int size;                   /* Capacity of buf */
+    int nbuf;                   /* Number of characters */
+    char buf[];                 /* Characters in the buffer */
+};
+
+/* sflush -- flush a stream by calling print_buf */
+static void sflush(struct stream *s) {
+    (*print_out())(s->buf, s->nbuf);
+    s->nbuf = 0;
+}
+
+/* f_streamc -- putc-function that stores characters in a stream */
+static void f_streamc(void *q, char c) {
+    struct stream *s = q;
+    if (s->nbuf == s->size) sflush(s);
+    s->buf[s->nbuf++] = c;
+    if (c == '\n' && s->mode == BUF_LINE) sflush(s);
+}
+
+/* print_setbuf -- install a buffer for printf in the current process */
+void print_setbuf(char *buf, int mode, int size) {
+    void **state = &print_state()[PS_STREAM];
+    struct stream *old = *state, *s;
+
+    if (old != NULL && old->nbuf > 0) sflush(old);
+
+    if (buf == NULL) {
+        *state = NULL;
+        return;
+    }
+
+    /* Use the start of the buffer for the bookkeeping */
+    s = (struct stream *) (((unsigned) buf + 3) & ~3);
+    size -= (char *) s->buf - buf;
+    if (size <= 0) {
+        *state = NULL;
+        return;
+    }
+
+    s->mode = mode;
+    s->size = size;
+    s->nbuf = 0;
+    *state = s;
+}
+
+/* print_flush -- flush the current process's printf buffer */
+void print_flush(void) {
+    struct stream *s = print_state()[PS_STREAM];
+    if (s != NULL && s->nbuf > 0) sflush(s);
+}
+
+/* print_redirect -- send the current process's printf output to out,
+   or back to print_buf if out is null */
+void print_redirect(void (*out)(char *buf, int n)) {
+    print_flush();
+    print_state()[PS_OUT] = (void *) out;
+}
+
 /* printf -- print using client-supplied print_buf */
 void printf(const char *fmt, ...) {
     va_list va;
-    struct buffer b;
-    b.nbuf = 0;
+    struct stream *s = print_state()[PS_STREAM];
+
     va_start(va, fmt);
-    _do_print(f_bufferc, &b, fmt, va);
+    if (s != NULL) {
+        _do_print(f_streamc, s, fmt, va);
+        if (s->mode == BUF_NONE && s->nbuf > 0) sflush(s);
+    } else {
+        struct buffer b;
+        b.nbuf = 0;
+        _do_print(f_bufferc, &b, fmt, va);
+        if (b.nbuf > 0) flush(&b);
+    }
     va_end(va);
-    if (b.nbuf > 0) flush(&b);
 }
 
 /* prandom -- pseudorandom numbers in the range [1 .. 2^31-1) */
@@ -11,6 +11,23 @@ void do_print(void (*putch)(char), const char *fmt, va_list va);
 /* printf -- print using putchar */
 void printf(const char *fmt, ...);
 
+/* Buffering modes for print_setbuf */
+#define BUF_NONE 0              /* Flush at the end of each printf */
+#define BUF_LINE 1              /* Flush at each newline */
+#define BUF_FULL 2              /* Flush only when full or on print_flush */
+
+/* print_setbuf -- give the current process its own printf buffer.
+   A null buf reverts to the default unbuffered behaviour. */
+void print_setbuf(char *buf, int mode, int size);
+
+/* print_flush -- send any output held in the process's printf buffer */
+void print_flush(void);
+
+/* print_redirect -- send the current process's printf output to another
+   function with the interface of print_buf, or back to print_buf if out
+   is null.  Other processes are not affected. */
+void print_redirect(void (*out)(char *buf, int n));
+
 /* sprintf -- print to string buffer.  Note danger of overflow! */
 int sprintf(char *buf, const char *fmt, ...);
 
@@ -0,0 +1,50 @@
+/* log.c */
+
+#include "microbian.h"
+#include <stdarg.h>
+
+/* Binary logging moves the work of formatting from the target to the
+host.  Each use of the LOG macro puts its format string in the
+.logstr section, which the linker script places at address 0 without
+loading it, so the address of the string is a small integer that
+identifies it.  A log record then consists of a sync byte, that index
+(two bytes, little-endian), an argument count, and four bytes for each
+argument.  The sync byte does not appear in ASCII text, so logdecode.py
+can sort out records from printf output on the same serial line, and it
+reads the strings back from the ELF file to reconstruct the messages.
+Text can still contain 0xff, from %c of 255 or a non-ASCII string, so
+the decoder only takes it as the start of a record if the index and
+argument count that follow make sense, and otherwise passes it through
+as text.  The index is limited to 16 bits, and the linker scripts check
+that .logstr fits. */
+
+#define LOG_SYNC 0xff           /* First byte of a record */
+#define LOG_HDR 4               /* Sync, index (2 bytes), arg count */
+
+/* log_write -- send a binary log record (called by LOG macro) */
+void log_write(const char *fmt, int nargs, ...)
+{
+    unsigned index = (unsigned) fmt;
+    byte rec[LOG_HDR + 4*LOG_MAXARGS];
+    int n = 0;
+    va_list va;
+
+    assert(nargs <= LOG_MAXARGS);
+
+    rec[n++] = LOG_SYNC;
+    rec[n++] = index & 0xff;
+    rec[n++] = (index >> 8) & 0xff;
+    rec[n++] = nargs;
+
+    va_start(va, nargs);
+    for (int i = 0; i < nargs; i++) {
+        unsigned x = va_arg(va, unsigned);
+        rec[n++] = x & 0xff;
+        rec[n++] = (x >> 8) & 0xff;
+        rec[n++] = (x >> 16) & 0xff;
+        rec[n++] = (x >> 24) & 0xff;
+    }
+    va_end(va);
+
+    serial_write(rec, n);
+}
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+
+import sys
+import struct
+
+"""
+This script decodes the binary records written by the LOG macro (see
+log.c), taking the format strings from the .logstr section of the ELF
+file for the program that produced them.  Any other output on the
+serial line is passed through unchanged, so ordinary printf output can
+be mixed with log records.
+
+Usage: logdecode.py <elf file> [<serial device or capture file>]
+"""
+
+LOG_SYNC = 0xff
+
+def read_logstr(elf_file):
+    with open(elf_file, 'rb') as f:
+        elf = f.read()
+
+    if elf[:4] != b'\x7fELF' or elf[4] != 1 or elf[5] != 1:
+        sys.exit(f"{elf_file}: not a little-endian ELF32 file")
+
+    shoff, = struct.unpack_from("<L", elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2e)
+
+    def section(i):
+        # name, type, flags, addr, offset, size
+        return struct.unpack_from("<LLLLLL", elf, shoff + i*shentsize)
+
+    strtab = section(shstrndx)
+    for i in range(shnum):
+        name, _, _, addr, offset, size = section(i)
+        start = strtab[4] + name
+        if elf[start:elf.index(b'\0', start)] == b'.logstr':
+            return addr, elf[offset:offset+size]
+
+    sys.exit(f"{elf_file}: no .logstr section")
+
+def fmt_string(table, index):
+    base, data = table
+    start = index - base
+    if start < 0 or start >= len(data):
+        return None
+    if start > 0 and data[start-1] != 0:
+        # Not the start of a string
+        return None
+    return data[start:data.index(b'\0', start)].decode('ascii', 'replace')
+
+LOG_MAXARGS = 6
+
+# do_field -- pad a prefix and string to a width like do_field in lib.c
+def do_field(pfx, s, width, flag):
+    w = width - len(pfx) - len(s)
+    if w <= 0:
+        return pfx + s
+    if flag == '0':
+        return pfx + '0'*w + s
+    if flag == '-':
+        return pfx + s + ' '*w
+    return ' '*w + pfx + s
+
+# do_format -- expand a format like _do_print in lib.c
+def do_format(fmt, args):
+    out = []
+    args = iter(args)
+    i = 0
+    while i < len(fmt):
+        ch = fmt[i]
+        if ch == '%' and i+1 < len(fmt):
+            i += 1
+            flag = ''
+            if fmt[i] in '-0':
+                flag = fmt[i]
+                i += 1
+            width = 0
+            while i < len(fmt) and fmt[i].isdigit():
+                width = 10*width + int(fmt[i])
+                i += 1
+            if i >= len(fmt):
+                break
+            conv = fmt[i]
+            if conv in "cdux":
+                x = next(args, 0)
+                if conv == 'c':
+                    c = chr(x & 0xff)
+                    pad = ' ' * max(width-1, 0)
+                    out.append(c + pad if flag == '-' else pad + c)
+                elif conv == 'd':
+                    if x & 0x80000000:
+                        out.append(do_field('-', str((1 << 32) - x),
+                                            width, flag))
+                    else:
+                        out.append(do_field('', str(x), width, flag))
+                elif conv == 'u':
+                    out.append(do_field('', str(x), width, flag))
+                else:
+                    out.append(do_field('0x' if x != 0 else '',
+                                        f"{x:x}", width, flag))
+            elif conv == 's':
+                next(args, 0)
+                out.append(do_field('', "<?>", width,
+                                    '' if flag == '0' else flag))
+            else:
+                out.append(conv)
+        else:
+            out.append(ch)
+        i += 1
+    return ''.join(out)
+
+# decode -- copy text from f to out, expanding log records.  A 0xff
+# byte can also occur in text, so it starts a record only if the index
+# and count after it are valid; otherwise it is output and the bytes
+# after it are looked at again.
+def decode(table, f, out):
+    pending = b''
+
+    def read(n):
+        nonlocal pending
+        while len(pending) < n:
+            b = f.read(n - len(pending))
+            if not b:
+                break
+            pending += b
+        data, pending = pending[:n], pending[n:]
+        return data
+
+    while True:
+        b = read(1)
+        if not b:
+            break
+        if b[0] != LOG_SYNC:
+            out.write(b.decode('latin-1'))
+            continue
+
+        hdr = read(3)
+        if len(hdr) < 3:
+            out.write((b + hdr).decode('latin-1'))
+            break
+        index, nargs = struct.unpack("<HB", hdr)
+        fmt = fmt_string(table, index)
+        if fmt is None or nargs > LOG_MAXARGS:
+            out.write(b.decode('latin-1'))
+            pending = hdr + pending
+            continue
+
+        raw = read(4*nargs)
+        if len(raw) < 4*nargs:
+            break
+        args = struct.unpack(f"<{nargs}L", raw)
+        out.write(do_format(fmt, args))
+        out.flush()
+
+if len(sys.argv) not in (2, 3):
+    print(f"Usage: {sys.argv[0]} <elf file> [<input file>]")
+    sys.exit(1)
+
+table = read_logstr(sys.argv[1])
+
+if len(sys.argv) == 3:
+    with open(sys.argv[2], 'rb', buffering=0) as f:
+        decode(table, f, sys.stdout)
+else:
+    decode(table, sys.stdin.buffer, sys.stdout)
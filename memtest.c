@@ -0,0 +1,96 @@
+/* memtest.c */
+
+/* Host check of the memcpy, memmove and memset in $(BOARD)/startup.c.
+The Makefile pastes those routines in front of this file, renamed to
+board_memcpy and so on, and builds it with the system cc.  Each is run
+over every source and destination alignment mod 8, every length up to
+MAXLEN, and for memmove every overlap up to SLIDE bytes either way.
+The results are compared against simple byte-by-byte versions, over
+the whole buffer, so that any store outside the destination is caught
+too. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BUFSIZE 512
+#define MAXLEN 200
+#define SLIDE 20
+
+static unsigned char src[BUFSIZE], init[BUFSIZE];
+static unsigned char want[BUFSIZE], got[BUFSIZE];
+
+static long ncases = 0, nbad = 0;
+
+/* ref_copy -- copy n bytes, going downwards if dest is above src */
+static void ref_copy(unsigned char *dest, const unsigned char *s, int n)
+{
+    if (dest <= s)
+        for (int i = 0; i < n; i++) dest[i] = s[i];
+    else
+        for (int i = n-1; i >= 0; i--) dest[i] = s[i];
+}
+
+/* reset -- fill want and got with the same random contents */
+static void reset(void)
+{
+    for (int i = 0; i < BUFSIZE; i++) want[i] = got[i] = init[i];
+}
+
+/* check -- compare want and got, and report the first difference */
+static void check(const char *what, int soff, int doff, int n, int ok)
+{
+    int i = 0;
+
+    ncases++;
+    while (i < BUFSIZE && want[i] == got[i]) i++;
+    if (i == BUFSIZE && ok) return;
+
+    if (nbad++ < 10) {
+        printf("%s src+%d dest+%d n=%d: ", what, soff, doff, n);
+        if (!ok)
+            printf("wrong result\n");
+        else
+            printf("byte %d is %d, not %d\n", i, got[i], want[i]);
+    }
+}
+
+int main(void)
+{
+    int base = BUFSIZE/2 - MAXLEN/2;
+
+    srand(2018);
+    for (int i = 0; i < BUFSIZE; i++) {
+        src[i] = rand();
+        init[i] = rand();
+    }
+
+    for (int soff = 0; soff < 8; soff++) {
+        for (int doff = 0; doff < 8; doff++) {
+            for (int n = 0; n <= MAXLEN; n++) {
+                void *r;
+
+                reset();
+                ref_copy(&want[doff], &src[soff], n);
+                r = board_memcpy(&got[doff], &src[soff], n);
+                check("memcpy", soff, doff, n, r == &got[doff]);
+
+                reset();
+                for (int i = 0; i < n; i++) want[doff+i] = 0x80 + soff;
+                r = board_memset(&got[doff], 0x80 + soff + 0x100, n);
+                check("memset", soff, doff, n, r == &got[doff]);
+
+                for (int d = -SLIDE; d <= SLIDE; d++) {
+                    int s0 = base + soff, d0 = base + doff + d;
+
+                    reset();
+                    ref_copy(&want[d0], &want[s0], n);
+                    r = board_memmove(&got[d0], &got[s0], n);
+                    check("memmove", s0, d0, n, r == &got[d0]);
+                }
+            }
+        }
+    }
+
+    printf("memtest: %ld cases, %ld failed\n", ncases, nbad);
+    return (nbad > 0);
+}
@@ -8,6 +8,10 @@
 
 #define _TIMEOUT 1
 
+#if defined(_TIMEOUT) && defined(PI_PICO)
+#define _UTIMEOUT 1
+#endif
+
 #define DEBUG_PIN_CONTENTION 4
 #define DEBUG_PIN_CORE0_KERNEL 5
 #define DEBUG_PIN_CORE1_KERNEL 6
@@ -43,11 +47,19 @@ struct _proc {
     
     proc waiting;             /* Processes waiting to send */
     int pending;              /* Whether HARDWARE message pending */
+    int pings;                /* Number of PINGs not yet received */
+    int ping_src;             /* Sender of latest PING */
+    int ping_val;             /* Value carried by latest PING */
     int filter;               /* Message type accepted by receive */
     message *msgbuf;          /* Pointer to message buffer */
 #ifdef _TIMEOUT
     int timeout;              /* Timeout for receive */
 #endif
+#ifdef _UTIMEOUT
+    int uwait;                /* Whether microsecond timeout set */
+    unsigned deadline;        /* Deadline in microseconds for receive */
+#endif
+    void *printstate[2];      /* Buffer and output for printf (see lib.c) */
     proc next;                /* Next process in ready or send queue */
 };
 
@@ -165,6 +177,20 @@ static void release_lock() {
 #endif
 }
 
+/* alloc -- allocate permanent storage for a driver process */
+void *alloc(int size)
+{
+    void *result;
+
+    /* Unlike start(), this may be called after the scheduler has
+       started, so take the lock to keep the heap consistent. */
+    acquire_lock();
+    result = sbrk(size);
+    release_lock();
+    return result;
+}
+
+
 /* PROCESS TABLE */
 
 #define NPROCS 32
@@ -291,6 +317,18 @@ static inline void deliver_special(proc pdst, int src, int type)
     }
 }
 
+/* deliver_ping -- deliver a PING message (see mini_ping) */
+static inline void deliver_ping(proc pdst, int src, int val, int overrun)
+{
+    message *buf = pdst->msgbuf;
+    if (buf) {
+        buf->type = PING;
+        buf->sender = src;
+        buf->int1 = val;
+        buf->int2 = overrun;
+    }
+}
+
 
 /* TIMEOUTS */
 
@@ -384,6 +422,113 @@ static void mini_tick(int ms)
 
 #endif
 
+/* On the Pi Pico, receive_us() is a form of receive() with a timeout
+in microseconds, measured by the free-running 1MHz TIMER rather than
+by ticks, and receive_until() is the same but with an absolute
+deadline on the timer_micros() clock.  Processes waiting with such a
+timeout are listed in utimeout[0..n_utimeouts), and hardware alarm 0
+is set for the earliest of their deadlines, so nothing at all happens
+until it is due. */
+
+#ifdef _UTIMEOUT
+
+static proc utimeout[NPROCS];
+static int n_utimeouts = 0;
+
+/* passed -- test if a deadline has been reached at time now */
+#define passed(deadline, now) ((int) ((now) - (deadline)) >= 0)
+
+/* set_alarm -- set alarm 0 for the earliest deadline */
+static void set_alarm(void)
+{
+    if (n_utimeouts == 0) {
+        TIMER_ARMED = BIT(TIMER_INT_ALARM0);
+        return;
+    }
+
+    unsigned next = utimeout[0]->deadline;
+    for (int i = 1; i < n_utimeouts; i++) {
+        if (!passed(utimeout[i]->deadline, next))
+            next = utimeout[i]->deadline;
+    }
+
+    /* The alarm only fires when the timer matches exactly, so if the
+       deadline has passed already, we force the interrupt. */
+    TIMER_ALARM0 = next;
+    if (passed(next, TIMER_TIMERAWL))
+        SET_BIT(TIMER_INTF, TIMER_INT_ALARM0);
+}
+
+/* set_utimeout -- schedule a timeout for process p at a deadline */
+static void set_utimeout(proc p, unsigned deadline)
+{
+    assert(n_utimeouts < NPROCS);
+    assert(!p->uwait);
+    p->uwait = 1;
+    p->deadline = deadline;
+    utimeout[n_utimeouts++] = p;
+    set_alarm();
+}
+
+/* cancel_utimeout -- cancel a microsecond timeout before it is due */
+static void cancel_utimeout(proc p)
+{
+    p->uwait = 0;
+
+    /* The alarm is left set: if it fires, nothing will be due. */
+    for (int i = 0; i < n_utimeouts; i++) {
+        if (utimeout[i] == p) {
+            utimeout[i] = utimeout[--n_utimeouts];
+            return;
+        }
+    }
+
+    panic("Cancelling an unset timeout");
+}
+
+/* timer0_handler -- fire microsecond timeouts that are due */
+void timer0_handler(void)
+{
+    acquire_lock();
+
+    TIMER_INTR = BIT(TIMER_INT_ALARM0);
+    CLR_BIT(TIMER_INTF, TIMER_INT_ALARM0);
+
+    unsigned now = TIMER_TIMERAWL;
+    int n = 0;
+    for (int j = 0; j < n_utimeouts; j++) {
+        proc pdst = utimeout[j];
+        if (!passed(pdst->deadline, now))
+            utimeout[n++] = pdst;
+        else {
+            pdst->uwait = 0;
+            deliver_special(pdst, HARDWARE, TIMEOUT);
+            make_ready(pdst);
+            if (os_current->priority > pdst->priority)
+                reschedule();
+        }
+    }
+    n_utimeouts = n;
+    set_alarm();
+
+    release_lock();
+}
+
+#endif
+
+/* stop_timeout -- cancel any timeout when a waiting process is woken */
+static inline void stop_timeout(proc p)
+{
+#ifdef _TIMEOUT
+    if (p->timeout != NO_TIME)
+        cancel_timeout(p);
+#endif
+#ifdef _UTIMEOUT
+    if (p->uwait)
+        cancel_utimeout(p);
+#endif
+}
+
 
 /* SEND AND RECEIVE */
 
@@ -481,10 +626,7 @@ static void mini_send(int dest, message *msg)
 
     if (accept(pdest, msg->type)) {
         /* Receiver is waiting: deliver the message and run receiver */
-#ifdef _TIMEOUT
-        if (pdest->timeout != NO_TIME)
-            cancel_timeout(pdest);
-#endif
+        stop_timeout(pdest);
         deliver(pdest, os_current);
         make_ready(os_current);
     } else {
@@ -512,6 +654,14 @@ static void mini_receive(int type, message *msg
         return;
     }
 
+    /* Then see if a PING has been held over */
+    if (os_current->pings > 0 && (type == ANY || type == PING)) {
+        deliver_ping(os_current, os_current->ping_src,
+                     os_current->ping_val, os_current->pings-1);
+        os_current->pings = 0;
+        return;
+    }
+
     /* Now see if a sender is waiting */
     if (type != INTERRUPT) {
         proc psrc = find_sender(os_current, type);
@@ -554,6 +704,29 @@ static void mini_receive(int type, message *msg
     choose_proc();
 }    
 
+/* PING messages can be sent with ping() as well as send().  If the
+receiver is not waiting for one, ping() does not block, but records the
+PING in the receiver's descriptor, where it will be found by the next
+receive() that accepts a PING.  If several PINGs arrive before that,
+they are merged into one that carries the value of the latest and, in
+int2, the number of earlier ones that were lost. */
+
+/* mini_ping -- send a PING without waiting */
+static void mini_ping(int dest, int val)
+{
+    proc pdest = find_dest(dest);
+
+    if (accept(pdest, PING)) {
+        stop_timeout(pdest);
+        deliver_ping(pdest, os_current->pid, val, 0);
+        make_ready(pdest);
+    } else {
+        pdest->pings++;
+        pdest->ping_src = os_current->pid;
+        pdest->ping_val = val;
+    }
+}
+
 /* mini_sendrec -- send a message and wait for reply */
 static void mini_sendrec(int dest, message *msg)
 {
@@ -566,6 +739,7 @@ static void mini_sendrec(int dest, message *msg)
 
     if (accept(pdest, msg->type)) {
         /* Send the message and wait for a reply */
+        stop_timeout(pdest);
         deliver(pdest, os_current);
         await_reply(os_current);
     } else {
@@ -608,6 +782,7 @@ void interrupt(int dest)
 
     if (accept(pdest, INTERRUPT)) {
         /* Receiver is waiting for an interrupt */
+        stop_timeout(pdest);
         deliver_special(pdest, HARDWARE, INTERRUPT);
         make_ready(pdest);
         if (os_current->priority > P_HANDLER) {
@@ -712,11 +887,16 @@ static proc create_proc(char *name, unsigned stksize)
     p->priority = P_LOW;
     p->waiting = 0;
     p->pending = 0;
+    p->pings = 0;
     p->filter = ANY;
 #ifdef _TIMEOUT
     p->timeout = NO_TIME;
+#endif
+#ifdef _UTIMEOUT
+    p->uwait = 0;
 #endif
     p->msgbuf = NULL;
+    p->printstate[0] = p->printstate[1] = NULL;
     p->next = NULL;
 
     return p;
@@ -823,6 +1003,12 @@ void __init(void)
     gpio_dir(DEBUG_PIN_CORE1_IDLE, 1);
 #endif
 
+#ifdef _UTIMEOUT
+    /* Alarm 0 is for microsecond timeouts: see timer0_handler */
+    SET_BIT(TIMER_INTE, TIMER_INT_ALARM0);
+    enable_irq_this_core(TIMER0_IRQ);
+#endif
+
     /* Run the main application setup routine. */
     init();
     /* Set all the interrupt handlers to a dummy value so we can panic
@@ -864,6 +1050,9 @@ void __start_core(void)
 #define SYS_RECEIVET 6
 #define SYS_TICK 7
 #define SYS_CONNECT 8
+#define SYS_PING 9
+#define SYS_RECEIVEU 10
+#define SYS_RECEIVEUNTIL 11
 
 /* System calls retrieve their arguments from the exception frame that
 was saved by the SVC instruction on entry to the operating system.  We
@@ -932,6 +1121,35 @@ unsigned *system_call(unsigned *psp)
         break;
 #endif
 
+#ifdef _UTIMEOUT
+    case SYS_RECEIVEU:
+        {
+            proc p = os_current;
+            unsigned usec = sysarg(2, unsigned);
+            mini_receive(sysarg(0, int), sysarg(1, message *),
+                         (usec == 0 ? 0 : -1));
+            if (p->state == RECEIVING)
+                set_utimeout(p, TIMER_TIMERAWL + usec);
+        }
+        break;
+
+    case SYS_RECEIVEUNTIL:
+        {
+            proc p = os_current;
+            unsigned deadline = sysarg(2, unsigned);
+            /* A deadline already passed behaves like a zero timeout */
+            mini_receive(sysarg(0, int), sysarg(1, message *),
+                         (passed(deadline, TIMER_TIMERAWL) ? 0 : -1));
+            if (p->state == RECEIVING)
+                set_utimeout(p, deadline);
+        }
+        break;
+#endif
+
+    case SYS_PING:
+        mini_ping(sysarg(0, int), sysarg(1, int));
+        break;
+
     case SYS_CONNECT:
         os_current->priority = P_HANDLER;
         {
@@ -1022,11 +1240,54 @@ void SYSCALL tick(int ms)
     syscall(SYS_TICK);
 }
 
+#ifdef _UTIMEOUT
+void SYSCALL receive_us(int type, message *msg, unsigned usec)
+{
+    syscall(SYS_RECEIVEU);
+}
+
+void SYSCALL receive_until(int type, message *msg, unsigned deadline)
+{
+    syscall(SYS_RECEIVEUNTIL);
+}
+#else
+/* Without a microsecond alarm, these fall back on the tick-driven
+timeouts of receive_t, rounding up to a whole millisecond so that they
+never return early. */
+
+/* receive_us -- receive with timeout in microseconds */
+void receive_us(int type, message *msg, unsigned usec)
+{
+    receive_t(type, msg, (usec + 999) / 1000);
+}
+
+/* receive_until -- receive with deadline on timer_micros() clock */
+void receive_until(int type, message *msg, unsigned deadline)
+{
+    int left = deadline - timer_micros();
+    receive_t(type, msg, (left > 0 ? (left + 999) / 1000 : 0));
+}
+#endif
+
 void SYSCALL connect(int irq)
 {
     syscall(SYS_CONNECT);
 }
 
+void SYSCALL ping(int dest, int val)
+{
+    syscall(SYS_PING);
+}
+
+/* print_state -- slots where printf keeps the current process's buffer
+   and output function */
+void **print_state(void)
+{
+    /* Each process only ever looks at its own descriptor here, so no
+       lock is needed. */
+    return os_current->printstate;
+}
+
 void send_msg(int dest, int type)
 {
     message m;
@@ -48,6 +48,9 @@ typedef struct {                /* 16 bytes */
 /* start -- create process that will run when init returns; return PID */
 int start(char *name, void (*body)(int), int arg, int stksize);
 
+/* alloc -- allocate permanent storage from the heap */
+void *alloc(int size);
+
 #define STACK 1024              /* Default stack size */
 
 /* SYSTEM CALLS */
@@ -61,12 +64,23 @@ void send_msg(int dst, int type);
 void send_int(int dst, int type, int val);
 void send_ptr(int dst, int type, void *ptr);
 
+/* ping -- send a PING message without waiting for the receiver */
+void ping(int dst, int val);
+
 /* receive -- receive a message */
 void receive(int type, message *msg);
 
 /* receive_t -- receive a message with timeout */
 void receive_t(int type, message *msg, int timeout);
 
+/* receive_us -- receive a message with timeout in microseconds.  On the
+   micro:bit, the timeout is rounded up to a whole millisecond. */
+void receive_us(int type, message *msg, unsigned usec);
+
+/* receive_until -- receive with deadline on timer_micros() clock.  The
+   deadline must be less than 2^31 usec (about 35 minutes) ahead. */
+void receive_until(int type, message *msg, unsigned deadline);
+
 /* sendrec -- send followed by receive */
 void sendrec(int dst, message *msg);
 
@@ -111,16 +125,30 @@ void spin(void);
 /* serial.c */
 void serial_putc(char ch);
 char serial_getc(void);
+void serial_write(const void *buf, int n);
 void serial_init(void);
 
 /* timer.c */
 void timer_delay(int msec);
-void timer_pulse(int msec);
-void timer_wait(void);
+void timer_delay_us(unsigned usec);
+int timer_pulse(int msec);
+int timer_cancel(int id);
+int timer_wait(void);
 unsigned timer_now(void);
 unsigned timer_micros(void);
+unsigned long long timer_micros64(void);
 void timer_init(void);
 
+/* A periodic activity with release times in microseconds; the period
+   must be less than 2^31 usec */
+typedef struct {
+    unsigned release;           /* Release time of current period */
+    unsigned period;            /* Interval between releases */
+} periodic;
+
+void periodic_init(periodic *p, unsigned period);
+int periodic_wait(periodic *p);
+
 /* i2c.c */
 int i2c_probe(int chan, int addr);
 int i2c_read_reg(int chan, int addr, int cmd);
@@ -130,12 +158,28 @@ void i2c_write_bytes(int chan, int addr, int cmd, byte *buf, int n);
 int i2c_xfer(int chan, int kind, int addr,
              byte *buf1, int n1, byte *buf2, int n2);
 void i2c_init(int chan);
+void i2c_config(int chan, unsigned scl, unsigned sda); /* Pico */
+
+/* One transaction in a list for i2c_batch */
+typedef struct {
+    int kind;                   /* READ or WRITE */
+    int addr;                   /* Device address */
+    byte *buf1;                 /* Command bytes */
+    int n1;
+    byte *buf2;                 /* Data to read or write */
+    int n2;
+} i2c_op;
+
+int i2c_batch(int chan, i2c_op *ops, int n);
+void i2c_batch_start(int chan, i2c_op *ops, int n);
 
 /* radio.c */
 #define RADIO_PACKET 128
 void radio_group(int group);
 void radio_send(void *buf, int n);
 int radio_receive(void *buf);
+int radio_subscribe(int filter);
+#define RADIO_UNSUBSCRIBE -2
 void radio_init(void);
 
 /* display.c */
@@ -148,3 +192,39 @@ void image_set(int x, int y, unsigned *img);
 /* adc.c */
 int adc_reading(int pin);
 void adc_init(void);
+
+/* Oversampled readings: 4^bits samples give bits extra bits */
+#define ADC_MAX_BITS 4
+#define ADC_MEDIAN 1            /* Median-of-3 spike filter first */
+int adc_filtered(int pin, int bits, int flags);
+int adc_celsius(int raw, int bits); /* Pico: degrees C * 256 */
+
+/* Continuous sampling into a ring of blocks (Pico and V2): rate is
+   per pin, blocks hold whole rounds of samples in increasing channel
+   order, and on the Pico nblocks is a power of 2 up to 16.  Each full
+   block is announced with a PING from the driver. */
+int adc_stream(const int *pins, int npins, int rate,
+               unsigned short *buf, int blocksize, int nblocks);
+unsigned short *adc_stream_wait(int *lost);
+void adc_stream_stop(void);
+
+/* log.c */
+
+/* LOG -- binary log record.  The format string is put in the
+   non-loaded .logstr section and only its offset there and up to
+   LOG_MAXARGS integer arguments are sent: use logdecode.py on the
+   host to turn the records back into text.  Formats may use %d, %u,
+   %x and %c, with a width and the '-' or '0' flag as in printf, but
+   not %s. */
+#define LOG(fmt, ...)                                                   \
+    do {                                                                \
+        static const char _logfmt[]                                     \
+            __attribute((section(".logstr"), used)) = fmt;              \
+        log_write(_logfmt, _LOG_NARGS(0, ##__VA_ARGS__), ##__VA_ARGS__); \
+    } while (0)
+
+#define LOG_MAXARGS 6
+#define _LOG_NARGS(...) _LOG_NARGS1(__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define _LOG_NARGS1(x0, x1, x2, x3, x4, x5, x6, n, ...) n
+
+void log_write(const char *fmt, int nargs, ...);
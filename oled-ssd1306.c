@@ -7,9 +7,9 @@ tag "v3.0.0" 8ca673c
 For use this SeeedStudio Expansion Board
 */
 
+#include "hardware.h"
 #include "ssd1306.h"
 #include "microbian.h"
-//#include "hardware.h"
 //#include "lib.h"
 
 //static int OLED_TASK;
@@ -24,39 +24,73 @@ unsigned short int _indexPage = START_PAGE_ADDR;
 static int ssd1306_send_command_stream(int chan, int addr, byte* pCommands, int len)
 {
   byte cmd = SSD1306_COMMAND_STREAM;
-  int status = i2c_xfer_surrogate(chan, WRITE, addr, &cmd, 1, pCommands, len);
+  int status = i2c_xfer(chan, WRITE, addr, &cmd, 1, pCommands, len);
   assert(status == OK);
 
   return status;
 }
 
-static int ssd1306_send_data_stream(int chan, int addr, byte* pdata, int len)
-{
-    byte buf1 = SSD1306_DATA_STREAM;
-    int status = i2c_xfer_surrogate(chan, WRITE, addr, &buf1, 1, pdata, len);
-    assert(status == OK);
-
-    return status;
-}
-
 static int ssd1306_send_command(int chan, int addr, int val)
 {
     byte buf1 = SSD1306_COMMAND;
     byte buf2 = val;
-    int status = i2c_xfer_surrogate(chan, WRITE, addr, &buf1, 1, &buf2, 1);
+    int status = i2c_xfer(chan, WRITE, addr, &buf1, 1, &buf2, 1);
     assert(status == OK);
 
     return status;
 }
 
-static int ssd1306_send_data(int chan, int addr, int val)
+/* Drawing is done in a copy of the display RAM, the framebuffer, and
+for each page (a strip 8 pixels high) we keep the range of columns
+that have changed since they were last sent.  ssd1306_flush() then
+sends just those ranges.  Runs of changed pages are sent through one
+window covering the union of their column ranges, and all the
+transfers of a flush go to the driver in one i2c_batch, so they share
+the bus with repeated starts.  If a window spans the full width, its
+pages are contiguous in the framebuffer and go in a single write,
+which the driver can send by DMA. */
+
+static byte framebuf[RAM_PAGES][RAM_X_END]
+     __attribute__((aligned(4)));
+static byte dirty_lo[RAM_PAGES], dirty_hi[RAM_PAGES]; /* lo > hi if clean */
+
+/* The framebuffer covers all 64 rows of display RAM, though only the
+first RAM_Y_END pages are shown on a 32-row panel unless the console
+(below) is scrolling through the rest.  Pages beyond those in use stay
+clean, so they cost nothing to flush. */
+
+static int npages = RAM_Y_END;  /* Pages in use */
+
+/* Console state, see below */
+static int con_on = 0;          /* Whether the console is active */
+static int con_top = 0;         /* Page of display RAM shown at the top */
+static int con_scroll = 0;      /* Whether con_top needs sending */
+static int con_row, con_x;      /* Cursor: line on screen, column */
+static int con_nl;              /* Newline waiting for next character */
+
+/* Pages are merged into one window if this wastes no more bytes than
+   a separate window would cost to set up */
+#define WINDOW_COST 8
+
+/* mark_dirty -- record a change to columns lo..hi of page p */
+static void mark_dirty(int p, int lo, int hi)
 {
-    byte buf1 = SSD1306_DATA;
-    byte buf2 = val;
-    int status = i2c_xfer_surrogate(chan, WRITE, addr, &buf1, 1, &buf2, 1);
-    assert(status == OK);
+    if (dirty_lo[p] > dirty_hi[p]) {
+        dirty_lo[p] = lo;
+        dirty_hi[p] = hi;
+    } else {
+        if (lo < dirty_lo[p]) dirty_lo[p] = lo;
+        if (hi > dirty_hi[p]) dirty_hi[p] = hi;
+    }
+}
 
-    return status;
+/* mark_clean -- mark all pages as unchanged */
+static void mark_clean(void)
+{
+    for (int p = 0; p < RAM_PAGES; p++) {
+        dirty_lo[p] = END_COLUMN_ADDR;
+        dirty_hi[p] = 0;
+    }
 }
 
 int ssd1306_off(void)
@@ -79,38 +113,116 @@ int ssd1306_inverse_screen(void)
     return ssd1306_send_command(I2C_EXTERNAL, SSD1306_ADDR, SSD1306_DIS_INVERSE);
 }
 
+/* fill_screen -- set every column of the framebuffer from a pattern */
+static void fill_screen(const byte *pattern, int n)
+{
+    for (int p = 0; p < RAM_Y_END; p++) {
+        for (int x = 0; x < RAM_X_END; x++)
+            framebuf[p][x] = pattern[x % n];
+        mark_dirty(p, 0, END_COLUMN_ADDR);
+    }
+}
+
 int ssd1306_clear_screenX(void)
 {
-    int status;
+    static const byte pattern[8] = {1|128,2|64,4|32,8|16,16|8,32|4,64|2,128|1};
+    fill_screen(pattern, 8);
+    return OK;
+}
+
+int ssd1306_clear_screen(void)
+{
+    static const byte pattern[1] = {CLEAR_COLOR};
+    fill_screen(pattern, 1);
+    return OK;
+}
 
-    byte buffer[8] = {1|128,2|64,4|32,8|16,16|8,32|4,64|2,128|1};
-    int i,j;
+/* The list of transfers is built and the pages marked clean before
+anything is sent, so that changes made while the transfers are in
+progress are sent by the next flush.  If a flush fails, everything is
+marked to be sent again. */
 
-    for (i = 0; i < RAM_Y_END ; i++)
-        for (j = 0; j < RAM_X_END; j++)
-	{
-            status = ssd1306_send_data_stream(I2C_EXTERNAL, SSD1306_ADDR, &buffer[0], 8);
-            if (status != OK) return status;
+#define MAX_OPS (2*RAM_PAGES+1)
+
+/* build_flush -- make list of transfers for changes and return length */
+static int build_flush(i2c_op *ops)
+{
+    static const byte cmd_stream = SSD1306_COMMAND_STREAM;
+    static const byte data_stream = SSD1306_DATA_STREAM;
+    static byte window[RAM_PAGES][6];
+    static byte start_line;
+    int nops = 0;
+    int p = 0;
+
+    while (p < RAM_PAGES) {
+        if (dirty_lo[p] > dirty_hi[p]) {
+            p++;
+            continue;
         }
 
-    return OK;
+        /* Extend the window over following pages while it pays */
+        int p1 = p, lo = dirty_lo[p], hi = dirty_hi[p];
+        int used = hi - lo + 1;
+        while (p1+1 < RAM_PAGES && dirty_lo[p1+1] <= dirty_hi[p1+1]) {
+            int lo1 = (dirty_lo[p1+1] < lo ? dirty_lo[p1+1] : lo);
+            int hi1 = (dirty_hi[p1+1] > hi ? dirty_hi[p1+1] : hi);
+            int used1 = used + dirty_hi[p1+1] - dirty_lo[p1+1] + 1;
+            if ((p1-p+2) * (hi1-lo1+1) - used1 > WINDOW_COST) break;
+            p1++; lo = lo1; hi = hi1; used = used1;
+        }
+
+        byte *w = window[p];
+        w[0] = SSD1306_SET_COLUMN_ADDR; w[1] = lo; w[2] = hi;
+        w[3] = SSD1306_SET_PAGE_ADDR; w[4] = p; w[5] = p1;
+        ops[nops++] = (i2c_op) { WRITE, SSD1306_ADDR,
+                                 (byte *) &cmd_stream, 1, w, 6 };
+
+        if (lo == 0 && hi == END_COLUMN_ADDR)
+            /* Pages p..p1 are contiguous in the framebuffer */
+            ops[nops++] = (i2c_op) { WRITE, SSD1306_ADDR,
+                                     (byte *) &data_stream, 1,
+                                     framebuf[p], (p1-p+1) * RAM_X_END };
+        else {
+            for (int q = p; q <= p1; q++)
+                ops[nops++] = (i2c_op) { WRITE, SSD1306_ADDR,
+                                         (byte *) &data_stream, 1,
+                                         &framebuf[q][lo], hi-lo+1 };
+        }
+
+        p = p1+1;
+    }
+
+    /* A scroll takes effect once the new line has been sent */
+    if (con_scroll) {
+        start_line = SSD1306_SET_START_LINE | (con_top * 8);
+        ops[nops++] = (i2c_op) { WRITE, SSD1306_ADDR,
+                                 (byte *) &cmd_stream, 1, &start_line, 1 };
+        con_scroll = 0;
+    }
+
+    mark_clean();
+    return nops;
 }
 
-int ssd1306_clear_screen(void)
+/* flush_failed -- arrange to send everything next time */
+static void flush_failed(void)
 {
-    int status;
+    for (int p = 0; p < npages; p++)
+        mark_dirty(p, 0, END_COLUMN_ADDR);
+    con_scroll = 1;
+}
 
-    byte buffer[8] = {0,0,0,0,0,0,0,0};
-    int i,j;
+/* ssd1306_flush -- send changed parts of the framebuffer to the display */
+int ssd1306_flush(void)
+{
+    i2c_op ops[MAX_OPS];
+    int nops = build_flush(ops), status;
 
-    for (i = 0; i < RAM_Y_END ; i++)
-        for (j = 0; j < RAM_X_END; j++)
-	{
-            status = ssd1306_send_data_stream(I2C_EXTERNAL, SSD1306_ADDR, &buffer[0], 8);
-            if (status != OK) return status;
-        }
+    if (nops == 0) return OK;
 
-    return OK;
+    status = i2c_batch(I2C_EXTERNAL, ops, nops);
+    if (status != OK) flush_failed();
+    return status;
 }
 
 const byte INIT_SSD1306_STREAM[] = {
@@ -147,7 +259,7 @@ unless we write a separate pre-task TWI to allow probe and setup
 hence name xxx_start() rather than xxx_init().
 
 Given the heavy weigth of context switches needed to interact with the ssd1306
-there would be no real harm in adding a driver wrapper.
+there would be no real harm in adding a driver wrapper -- see oled_init below.
 
 */
 
@@ -161,106 +273,556 @@ int ssd1306_start(void)
   if (status != OK) return status;
 #endif
   status = ssd1306_send_command_stream(I2C_EXTERNAL, SSD1306_ADDR, pCommands, sizeof(INIT_SSD1306_STREAM) );
+
+  /* The display RAM is in an unknown state, so the first flush must
+     send everything */
+  mark_clean();
+  flush_failed();
+
   return status;
 }
 
-static int ssd1306_set_window(byte x1, byte x2, byte y1, byte y2)
+int ssd1306_set_position(byte x, byte y)
 {
-    int status;
-    byte window_buffer[6] = {SSD1306_SET_COLUMN_ADDR, x1, x2,
-                             SSD1306_SET_PAGE_ADDR,   y1, y2};
+    _indexCol = x;
+    _indexPage = y;
+    return OK;
+}
 
-    status = ssd1306_send_command_stream(I2C_EXTERNAL, SSD1306_ADDR, window_buffer, sizeof(window_buffer));
-    assert(status == OK);
+/* Text is rendered a whole string at a time: the glyphs and the
+blank columns between them are copied straight into each page of the
+framebuffer, and the changed span on each page is marked just once, so
+that the flush sends the text as one data write per page.  At scale 2
+or 3, each glyph column is spread over 2 or 3 pages by looking up the
+nibbles of each byte in font_expand2 or font_expand3, and the result is
+repeated across as many columns. */
 
-    _indexCol = x1;
-    _indexPage = y1;
+static const font *cur_font = &OLED_FONT;
+static int cur_scale = 1, cur_prop = 0;
 
-    return status;
+/* ssd1306_set_font -- choose font, scale (1 to 3) and spacing for text */
+int ssd1306_set_font(const font *f, int scale, int prop)
+{
+    if (scale < 1 || scale > 3) return SSD1306_ERROR;
+    cur_font = f;
+    cur_scale = scale;
+    cur_prop = prop;
+    return OK;
 }
 
-int ssd1306_set_position(byte x, byte y)
+/* put_column -- draw one scaled glyph column at column x of page p */
+static void put_column(int p, int x, byte b, int s)
+{
+    byte col[3];
+    unsigned v;
+
+    switch (s) {
+    case 1:
+        framebuf[p][x] = b;
+        return;
+    case 2:
+        col[0] = font_expand2[b & 0xf];
+        col[1] = font_expand2[b >> 4];
+        break;
+    default:
+        v = font_expand3[b & 0xf] | (font_expand3[b >> 4] << 12);
+        col[0] = v & 0xff;
+        col[1] = (v >> 8) & 0xff;
+        col[2] = v >> 16;
+    }
+
+    for (int r = 0; r < s; r++)
+        for (int k = 0; k < s; k++)
+            framebuf[p+r][x+k] = col[r];
+}
+
+/* mark_text -- mark columns lo..hi dirty on the s pages from p */
+static void mark_text(int p, int s, int lo, int hi)
 {
-   return ssd1306_set_window(x, END_COLUMN_ADDR, y, END_PAGE_ADDR);
+    if (lo > hi) return;
+    for (int r = 0; r < s; r++)
+        mark_dirty(p+r, lo, hi);
 }
 
-static int ssd1306_update_position(byte x, byte p)
+/* render_text -- draw n characters at the cursor, wrapping at the edge */
+static int render_text(const char *str, int n)
 {
-   int status;
+    int s = cur_scale;
+    int p = _indexPage, x = _indexCol, x0 = x;
+    int status = OK;
+
+    if (p + s > npages) return SSD1306_ERROR;
+
+    for (int i = 0; i < n; i++) {
+        int w;
+        const byte *g =
+            font_glyph(cur_font, (unsigned char) str[i], cur_prop, &w);
+
+        if (x + w*s > RAM_X_END) {
+            if (p + 2*s > npages) {
+                status = SSD1306_ERROR; //last page reached
+                break;
+            }
+            mark_text(p, s, x0, x-1);
+            p += s; x = x0 = 0;
+        }
 
-   if (x > END_COLUMN_ADDR) {
-      if (p < END_PAGE_ADDR) {
-         _indexCol = 0;
-         _indexPage++;
-         status = ssd1306_set_position(_indexCol, _indexPage);
-         if (status != OK) return status;
-      }
-      else
-         return SSD1306_ERROR; //last page reached
-   }
+        for (int j = 0; j < w; j++, x += s)
+            put_column(p, x, g[j], s);
+        if (x + s <= RAM_X_END) {
+            put_column(p, x, 0, s);
+            x += s;
+        }
+    }
 
-   return OK;
+    mark_text(p, s, x0, x-1);
+    _indexCol = x;
+    _indexPage = p;
+    return status;
 }
 
 int ssd1306_draw_character(char ch)
 {
-    int status;
-    byte* pdata = (byte*)&FONTS[ch-32][0];
+    return render_text(&ch, 1);
+}
 
-    status = ssd1306_update_position(_indexCol + CHARS_COLS_LENGTH, _indexPage);
-    if (status != OK) return status;
+int ssd1306_draw_string(char *str)
+{
+    int n = 0;
+    while (str[n] != '\0') n++;
+    return render_text(str, n);
+}
 
-    status = ssd1306_send_data_stream(I2C_EXTERNAL, SSD1306_ADDR, pdata, CHARS_COLS_LENGTH);
-    if (status != OK) return status;
-    _indexCol += CHARS_COLS_LENGTH;
+/* GRAPHICS */
 
-    status = ssd1306_send_data(I2C_EXTERNAL, SSD1306_ADDR, 0);
+/* Drawing works on whole pages: the rows that a shape covers within a
+page make a byte mask, and the mask is applied to a span of columns
+four at a time, with one 32-bit word holding four columns.  A mode is
+expressed as a pair of masks, so that each word is updated by
+(v & ~(m & clr)) ^ (m & flip) whatever the mode, with no tests in the
+inner loop.  Bitmaps are in the same format as the framebuffer, and
+are drawn at any row by shifting each byte within its lane of the word
+and spilling the rest into the next page.  Everything is clipped to the
+screen. */
 
-    _indexCol++;
+#define ALL4(b) ((b) * 0x01010101u)
 
-    return status;
+/* Four columns of a page, accessed as one word; may_alias tells GCC
+   that these words overlap the bytes of the framebuffer */
+typedef unsigned __attribute__((may_alias)) word4;
+
+#define APPLY(v, m) (((v) & ~((m) & clr)) ^ ((m) & flip))
+
+/* mode_masks -- find the clear and flip masks for a drawing mode */
+static void mode_masks(int mode, unsigned *clr, unsigned *flip)
+{
+    *clr = (mode != PIXEL_XOR ? ~0 : 0);
+    *flip = (mode != PIXEL_OFF ? ~0 : 0);
 }
 
-int ssd1306_draw_string(char *str)
+/* fill_span -- apply a row mask to columns x0..x1 of page p */
+static void fill_span(int p, int x0, int x1, byte mask, int mode)
+{
+    byte *row = framebuf[p];
+    unsigned m4 = ALL4(mask), clr, flip;
+    int x = x0;
+
+    mode_masks(mode, &clr, &flip);
+
+    while (x <= x1 && (x & 3) != 0) {
+        row[x] = APPLY(row[x], mask); x++;
+    }
+    while (x+3 <= x1) {
+        word4 *w = (word4 *) &row[x];
+        *w = APPLY(*w, m4); x += 4;
+    }
+    while (x <= x1) {
+        row[x] = APPLY(row[x], mask); x++;
+    }
+
+    mark_dirty(p, x0, x1);
+}
+
+/* clip -- clip a range of n from a to lo..hi, returning false if empty */
+static int clip(int *a, int *n, int lo, int hi)
+{
+    int b = *a + *n - 1;
+    if (*a < lo) *a = lo;
+    if (b > hi) b = hi;
+    *n = b - *a + 1;
+    return *n > 0;
+}
+
+/* ssd1306_fill_rect -- draw a w x h rectangle with top left at (x, y) */
+void ssd1306_fill_rect(int x, int y, int w, int h, int mode)
 {
-   int status = OK;
+    int y1;
 
-   while ((*str != '\0') && (status == OK))
-      status = ssd1306_draw_character(*str++);
+    if (!clip(&x, &w, 0, END_COLUMN_ADDR) || !clip(&y, &h, 0, MAX_Y-1))
+        return;
+    y1 = y + h - 1;
 
-   return status;
+    for (int p = y >> 3; p <= y1 >> 3; p++) {
+        int lo = (p == y >> 3 ? y & 7 : 0);
+        int hi = (p == y1 >> 3 ? y1 & 7 : 7);
+        fill_span(p, x, x+w-1, (0xff << lo) & (0xff >> (7-hi)), mode);
+    }
 }
 
-#if 0
-static void oled_task(int target_task)
+/* ssd1306_hline -- draw a horizontal line of w pixels from (x, y) */
+void ssd1306_hline(int x, int y, int w, int mode)
 {
-     int status;
-    /*Without moding microbian no way of telling if I2C task is already running*/
-    /*However, i2c_init is designed so that no harm in calling if already setup*/
+    ssd1306_fill_rect(x, y, w, 1, mode);
+}
 
-     i2c_init(I2C_EXTERNAL);
+/* ssd1306_vline -- draw a vertical line of h pixels from (x, y) */
+void ssd1306_vline(int x, int y, int h, int mode)
+{
+    ssd1306_fill_rect(x, y, 1, h, mode);
+}
 
-     while (1) {
-        status = ssd1306_start();
-        if (status != OK)
-           yield();
-        else {
-           status = ssd1306_clear_screenX();
-           if (status == OK) {
-              if (target_task != 0)
-	         send(target_task, OLED_READY, NULL);
-              exit();
-           }
+/* ssd1306_cursor -- invert a w x h block, so drawing it twice removes it */
+void ssd1306_cursor(int x, int y, int w, int h)
+{
+    ssd1306_fill_rect(x, y, w, h, PIXEL_XOR);
+}
+
+/* ssd1306_pixel -- set, clear or invert one pixel */
+void ssd1306_pixel(int x, int y, int mode)
+{
+    ssd1306_fill_rect(x, y, 1, 1, mode);
+}
+
+/* blit_row -- draw columns x0..x1 from one page of a bitmap with
+   the rows in smask, shifted down by d rows from the top of page p.
+   p may be -1, and then only the rows that reach page 0 are drawn. */
+static void blit_row(int p, int x0, int x1, const byte *src, int d,
+                     byte smask, int mode)
+{
+    byte *lo_row = (p >= 0 ? framebuf[p] : NULL);
+    byte *hi_row = (d > 0 && p < END_PAGE_ADDR ? framebuf[p+1] : NULL);
+    unsigned s4 = ALL4(smask), lom = ALL4((0xff << d) & 0xff),
+        him = ALL4(0xff >> (8-d)), clr, flip;
+    int x = x0;
+
+    mode_masks(mode, &clr, &flip);
+
+    while (x <= x1) {
+        const byte *s = &src[x-x0];
+
+        if ((x & 3) == 0 && x+3 <= x1) {
+            /* The bitmap may be unaligned, so assemble the word */
+            unsigned v = (s[0] | s[1] << 8 | s[2] << 16 | s[3] << 24) & s4;
+            word4 *w;
+            if (lo_row) {
+                w = (word4 *) &lo_row[x];
+                *w = APPLY(*w, (v << d) & lom);
+            }
+            if (hi_row) {
+                w = (word4 *) &hi_row[x];
+                *w = APPLY(*w, (v >> (8-d)) & him);
+            }
+            x += 4;
+        } else {
+            unsigned v = *s & smask;
+            if (lo_row) lo_row[x] = APPLY(lo_row[x], (v << d) & 0xff);
+            if (hi_row) hi_row[x] = APPLY(hi_row[x], v >> (8-d));
+            x++;
         }
-     }
+    }
 
+    if (lo_row) mark_dirty(p, x0, x1);
+    if (hi_row) mark_dirty(p+1, x0, x1);
 }
 
-void ssd1306_init(int target_task)
+/* ssd1306_blit -- draw a w x h bitmap with top left at (x, y).  The
+   bitmap has (h+7)/8 pages of w bytes in the framebuffer format; set
+   bits are drawn in the given mode and clear bits leave the screen as
+   it is.  Parts that fall off any edge of the screen are clipped. */
+void ssd1306_blit(int x, int y, const byte *bmp, int w, int h, int mode)
 {
-   //exit after getting setup and clearing screen
-   //message target task before exiting
-   start("Oled", oled_task, target_task, 256);
+    int x0 = x, n = w, d = y & 7;
+
+    if (!clip(&x, &n, 0, END_COLUMN_ADDR)) return;
+
+    for (int sp = 0; sp < (h+7)/8; sp++) {
+        /* y >> 3 rounds down, so rows above the screen go to page -1
+           or less, and d still gives the shift */
+        int p = (y >> 3) + sp;
+        int rows = (h - 8*sp < 8 ? h - 8*sp : 8);
+        if (p > END_PAGE_ADDR) break;
+        if (p < -1 || (p == -1 && d == 0)) continue;
+        blit_row(p, x, x+n-1, &bmp[sp*w + (x-x0)], d,
+                 0xff >> (8-rows), mode);
+    }
 }
-#endif
 
+/* CONSOLE */
+
+/* The console prints lines of text continuously, scrolling up when
+the bottom line is full.  Rather than redraw the screen, it treats
+display RAM as a ring of pages and moves the display start line, so
+that scrolling costs a write of the one page that holds the new line,
+plus a single command, sent by the flush after the page data.  The
+start line counts modulo the 64 rows of display RAM even on a 32-row
+panel, so the ring has all RAM_PAGES pages and the page that comes
+into view is cleared as it does.  A newline is held back until the
+next character, so that the last line of output stays on the screen
+instead of being scrolled away by its own newline.  The console draws
+in the current font at scale 1, and other drawing calls still address
+display RAM directly while it is active. */
+
+/* con_newline -- move to the start of the next line, scrolling if needed */
+static void con_newline(void)
+{
+    con_x = 0;
+    if (con_row < RAM_Y_END-1) {
+        con_row++;
+        return;
+    }
+
+    fill_span((con_top + RAM_Y_END) % RAM_PAGES, 0, END_COLUMN_ADDR,
+              0xff, PIXEL_OFF);
+    con_top = (con_top + 1) % RAM_PAGES;
+    con_scroll = 1;
+}
+
+/* ssd1306_console -- clear the display and start or stop the console */
+int ssd1306_console(int on)
+{
+    con_on = on;
+    npages = (on ? RAM_PAGES : RAM_Y_END);
+    for (int p = 0; p < npages; p++)
+        fill_span(p, 0, END_COLUMN_ADDR, 0xff, PIXEL_OFF);
+    con_top = con_row = con_x = con_nl = 0;
+    con_scroll = 1;
+    return OK;
+}
+
+/* ssd1306_console_write -- print n characters on the console */
+void ssd1306_console_write(const char *buf, int n)
+{
+    int scale = cur_scale;
+
+    if (!con_on) return;
+    cur_scale = 1;
+
+    for (int i = 0; i < n; i++) {
+        char ch = buf[i];
+        int w;
+
+        switch (ch) {
+        case '\r':
+            con_x = 0;
+            break;
+
+        case '\n':
+            if (con_nl) con_newline();
+            con_nl = 1;
+            break;
+
+        default:
+            if (con_nl) {
+                con_newline();
+                con_nl = 0;
+            }
+            font_glyph(cur_font, (unsigned char) ch, cur_prop, &w);
+            if (con_x + w > RAM_X_END) con_newline();
+            _indexPage = (con_top + con_row) % RAM_PAGES;
+            _indexCol = con_x;
+            render_text(&ch, 1);
+            con_x = _indexCol;
+        }
+    }
+
+    cur_scale = scale;
+}
+
+/* OLED DRIVER PROCESS */
+
+/* The functions above are called directly by the process that owns
+the display, and ssd1306_flush waits for the transfers to finish.  As
+an alternative, oled_init starts a driver process that owns the
+framebuffer and accepts drawing and flush requests as messages, so
+that clients wait only for it to accept each request, never for the
+display itself.  The process starts a flush with i2c_batch_start and
+goes on accepting requests until the reply comes from the I2C driver;
+changes made meanwhile are sent by the next flush, so successive
+updates to the same place cost only one transfer.  Flushes are spaced
+out to give at most the frame rate passed to oled_init: a request that
+comes too soon is remembered and carried out when the time comes. */
+
+static int OLED_TASK;
+
+/* Message types */
+#define OLED_CLEAR 16
+#define OLED_TEXT 17
+#define OLED_FLUSH 18
+#define OLED_SETFONT 19
+#define OLED_CONSOLE 20
+#define OLED_WRITE 21
+
+/* An OLED_TEXT message has the position in byte1 and byte2, or
+byte4 = 1 to continue from the last one, the number of characters in
+byte3, and the characters themselves in int2 and int3, so that the
+client is free to change its string as soon as the message is sent.
+OLED_WRITE carries console output in the same way, and asks for a
+flush, so that output appears without the client calling oled_flush. */
+
+#define TEXT_CHUNK 8            /* Characters carried in int2, int3 */
+
+/* due -- test if time t has been reached */
+#define due(t) ((int) (timer_micros() - (t)) >= 0)
+
+static void oled_task(int fps)
+{
+    static i2c_op ops[MAX_OPS];
+    unsigned period = 1000000 / fps;
+    unsigned next;              /* Earliest time for next flush */
+    int busy = 0, wanted = 0;
+    message m;
+
+    ssd1306_start();
+    next = timer_micros();
+
+    while (1) {
+        if (wanted && !busy)
+            receive_until(ANY, &m, next);
+        else
+            receive(ANY, &m);
+
+        switch (m.type) {
+        case OLED_CLEAR:
+            ssd1306_clear_screen();
+            break;
+
+        case OLED_TEXT:
+            {
+                char *t = (char *) &m.int2;
+                if (!m.byte4)
+                    ssd1306_set_position(m.byte1, m.byte2);
+                render_text(t, m.byte3);
+            }
+            break;
+
+        case OLED_SETFONT:
+            ssd1306_set_font(m.ptr1, m.int2, m.int3);
+            break;
+
+        case OLED_CONSOLE:
+            ssd1306_console(m.int1);
+            wanted = 1;
+            break;
+
+        case OLED_WRITE:
+            ssd1306_console_write((char *) &m.int2, m.byte3);
+            wanted = 1;
+            break;
+
+        case OLED_FLUSH:
+            wanted = 1;
+            break;
+
+        case REPLY:
+            /* The I2C driver has finished a flush */
+            busy = 0;
+            if (m.int1 != OK) flush_failed();
+            break;
+
+        case TIMEOUT:
+            break;
+
+        default:
+            badmesg(m.type);
+        }
+
+        if (wanted && !busy && due(next)) {
+            int nops = build_flush(ops);
+            if (nops > 0) {
+                i2c_batch_start(I2C_EXTERNAL, ops, nops);
+                busy = 1;
+            }
+            wanted = 0;
+            next = timer_micros() + period;
+        }
+    }
+}
+
+/* oled_init -- start the display driver process */
+void oled_init(int fps)
+{
+    i2c_init(I2C_EXTERNAL);
+    OLED_TASK = start("Oled", oled_task, fps, 512);
+}
+
+/* oled_clear -- clear the display */
+void oled_clear(void)
+{
+    send_msg(OLED_TASK, OLED_CLEAR);
+}
+
+/* oled_text -- draw a string starting at column x of page p */
+void oled_text(int x, int p, const char *str)
+{
+    message m;
+    char *t = (char *) &m.int2;
+    int n;
+
+    /* A long string is sent in pieces, each continuing where the last
+       left off */
+    m.type = OLED_TEXT;
+    m.byte1 = x;
+    m.byte2 = p;
+    m.byte4 = 0;
+    while (*str != '\0') {
+        for (n = 0; n < TEXT_CHUNK && str[n] != '\0'; n++)
+            t[n] = str[n];
+        m.byte3 = n;
+        send(OLED_TASK, &m);
+        str += n;
+        m.byte4 = 1;
+    }
+}
+
+/* oled_font -- choose the font, scale and spacing for later text */
+void oled_font(const font *f, int scale, int prop)
+{
+    message m;
+    m.type = OLED_SETFONT;
+    m.ptr1 = (void *) f;
+    m.int2 = scale;
+    m.int3 = prop;
+    send(OLED_TASK, &m);
+}
+
+/* oled_flush -- ask for the display to be updated */
+void oled_flush(void)
+{
+    send_msg(OLED_TASK, OLED_FLUSH);
+}
+
+/* oled_console -- start or stop the scrolling console */
+void oled_console(int on)
+{
+    message m;
+    m.type = OLED_CONSOLE;
+    m.int1 = on;
+    send(OLED_TASK, &m);
+}
+
+/* oled_print_buf -- print on the console; print_redirect(oled_print_buf)
+   sends the output of printf there */
+void oled_print_buf(char *buf, int n)
+{
+    message m;
+    char *t = (char *) &m.int2;
+
+    m.type = OLED_WRITE;
+    while (n > 0) {
+        int k = (n < TEXT_CHUNK ? n : TEXT_CHUNK);
+        for (int i = 0; i < k; i++) t[i] = buf[i];
+        m.byte3 = k;
+        send(OLED_TASK, &m);
+        buf += k; n -= k;
+    }
+}
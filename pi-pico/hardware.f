@@ -80,8 +80,11 @@ argument to be a macro that expands the a 'position, width' pair. */
 #define TIMER1_IRQ 1
 #define TIMER2_IRQ 2
 #define TIMER3_IRQ 3
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
 #define UART0_IRQ 20
 #define UART1_IRQ 21
+#define ADC_IRQ 22
 #define I2C0_IRQ 23
 #define I2C1_IRQ 24
 #define RTC_IRQ 25
@@ -525,6 +528,10 @@ DEVICE timer {
     REGISTER unsigned DBGPAUSE @ 0x2c;
     REGISTER unsigned PAUSE @ 0x30;
     REGISTER unsigned INTR @ 0x34;
+#define TIMER_INT_ALARM0 __BIT(0)
+#define TIMER_INT_ALARM1 __BIT(1)
+#define TIMER_INT_ALARM2 __BIT(2)
+#define TIMER_INT_ALARM3 __BIT(3)
     REGISTER unsigned INTE @ 0x38;
     REGISTER unsigned INTF @ 0x3c;
     REGISTER unsigned INTS @ 0x40;
@@ -552,6 +559,10 @@ DEVICE watchdog {
 INSTANCE watchdog WATCHDOG @ 0x40058000;
 
 
+/* Two I2C buses; the external bus is the one used for the OLED */
+#define I2C_EXTERNAL 0
+#define N_I2CS 2
+
 /* 4.4.16 */
 DEVICE i2c {
     REGISTER unsigned CON @ 0x00;
@@ -586,6 +597,19 @@ DEVICE i2c {
     REGISTER unsigned FS_SCL_LCNT @ 0x20;
     REGISTER unsigned INTR_STAT @ 0x2c;
     REGISTER unsigned INTR_MASK @ 0x30;
+#define I2C_INTR_RX_UNDER    __BIT(0)
+#define I2C_INTR_RX_OVER     __BIT(1)
+#define I2C_INTR_RX_FULL     __BIT(2)
+#define I2C_INTR_TX_OVER     __BIT(3)
+#define I2C_INTR_TX_EMPTY    __BIT(4)
+#define I2C_INTR_RD_REQ      __BIT(5)
+#define I2C_INTR_TX_ABRT     __BIT(6)
+#define I2C_INTR_RX_DONE     __BIT(7)
+#define I2C_INTR_ACTIVITY    __BIT(8)
+#define I2C_INTR_STOP_DET    __BIT(9)
+#define I2C_INTR_START_DET   __BIT(10)
+#define I2C_INTR_GEN_CALL    __BIT(11)
+#define I2C_INTR_RESTART_DET __BIT(12)
     REGISTER unsigned RAW_INTR_STAT @ 0x34;
 #define I2C_RAW_INTR_STAT_TX_EMPTY   __BIT(4)
 #define I2C_RAW_INTR_STAT_R_TX_EMPTY_INACTIVE   0
@@ -611,9 +635,12 @@ DEVICE i2c {
     REGISTER unsigned TXFLR @ 0x74;
     REGISTER unsigned RXFLR @ 0x78;
     REGISTER unsigned SDA_HOLD @ 0x7c;
+#define I2C_SDA_HOLD_TX __FIELD(0, 16)
     REGISTER unsigned TX_ABRT_SOURCE @ 0x80;
     REGISTER unsigned SLV_DATA_NACK_ONLY @ 0x84;
     REGISTER unsigned DMA_CR @ 0x88;
+#define I2C_DMA_CR_RDMAE __BIT(0)
+#define I2C_DMA_CR_TDMAE __BIT(1)
     REGISTER unsigned DMA_TDLR @ 0x8c;
     REGISTER unsigned DMA_RDLR @ 0x90;
     REGISTER unsigned SDA_SETUP @ 0x94;
@@ -689,14 +716,30 @@ DEVICE adc {
 #define ADC_CS_EN __BIT(0)
 #define ADC_CS_TS_EN __BIT(1)
 #define ADC_CS_START_ONCE __BIT(2)
+#define ADC_CS_START_MANY __BIT(3)
 #define ADC_CS_READY __BIT(8)
 #define ADC_CS_ERR __BIT(9)
+#define ADC_CS_ERR_STICKY __BIT(10)
 #define ADC_CS_AINSEL __FIELD(12,3)
+#define ADC_CS_RROBIN __FIELD(16,5)
     REGISTER unsigned RESULT @ 0x04; /* Mask low 12 bits for result */
     REGISTER unsigned FCS @ 0x08;
+#define ADC_FCS_EN __BIT(0)
+#define ADC_FCS_SHIFT __BIT(1)
+#define ADC_FCS_ERR __BIT(2)
+#define ADC_FCS_DREQ_EN __BIT(3)
+#define ADC_FCS_EMPTY __BIT(8)
+#define ADC_FCS_FULL __BIT(9)
+#define ADC_FCS_UNDER __BIT(10)
+#define ADC_FCS_OVER __BIT(11)
+#define ADC_FCS_LEVEL __FIELD(16,4)
+#define ADC_FCS_THRESH __FIELD(24,4)
     REGISTER unsigned FIFO @ 0x0c;
+#define ADC_FIFO_VAL __FIELD(0,12)
+#define ADC_FIFO_ERR __BIT(15)
     REGISTER unsigned DIV @ 0x10;
     REGISTER unsigned INTR @ 0x14;
+#define ADC_INTR_FIFO __BIT(0)
     REGISTER unsigned INTE @ 0x18;
     REGISTER unsigned INTF @ 0x1c;
     REGISTER unsigned INTS @ 0x20;
@@ -704,6 +747,61 @@ DEVICE adc {
 INSTANCE adc ADC @ 0x4004c000;
 
 
+/* 2.5.7 */
+/* The 12 DMA channels each have a block of registers 0x40 apart;
+DMA_CHAN(n, reg) names register reg of channel n. */
+DEVICE dma_chan {
+    REGISTER unsigned READ_ADDR @ 0x00;
+    REGISTER unsigned WRITE_ADDR @ 0x04;
+    REGISTER unsigned TRANS_COUNT @ 0x08;
+    REGISTER unsigned CTRL_TRIG @ 0x0c;
+#define DMA_CTRL_EN            __BIT(0)
+#define DMA_CTRL_HIGH_PRIORITY __BIT(1)
+#define DMA_CTRL_DATA_SIZE     __FIELD(2, 2)
+#define DMA_SIZE_BYTE              0
+#define DMA_SIZE_HALFWORD          1
+#define DMA_SIZE_WORD              2
+#define DMA_CTRL_INCR_READ     __BIT(4)
+#define DMA_CTRL_INCR_WRITE    __BIT(5)
+#define DMA_CTRL_RING_SIZE     __FIELD(6, 4)
+#define DMA_CTRL_RING_SEL      __BIT(10)
+#define DMA_CTRL_CHAIN_TO      __FIELD(11, 4)
+#define DMA_CTRL_TREQ_SEL      __FIELD(15, 6)
+#define DMA_CTRL_IRQ_QUIET     __BIT(21)
+#define DMA_CTRL_BSWAP         __BIT(22)
+#define DMA_CTRL_BUSY          __BIT(24)
+#define DMA_CTRL_WRITE_ERROR   __BIT(29)
+#define DMA_CTRL_READ_ERROR    __BIT(30)
+    REGISTER unsigned AL1_CTRL @ 0x10;
+    REGISTER unsigned AL2_WRITE_ADDR_TRIG @ 0x2c;
+};
+INSTANCE dma_chan DMA0 @ 0x50000000;
+
+#define DMA_CHAN(n, reg) (* (&DMA0_##reg + 16*(n)))
+#define N_DMA_CHANS 12
+
+/* Data request signals for TREQ_SEL */
+#define DREQ_I2C0_TX 32
+#define DREQ_I2C0_RX 33
+#define DREQ_I2C1_TX 34
+#define DREQ_I2C1_RX 35
+#define DREQ_ADC 36
+#define DREQ_PERMANENT 0x3f
+
+DEVICE dma {
+    REGISTER unsigned INTR @ 0x400;
+    REGISTER unsigned INTE0 @ 0x404;
+    REGISTER unsigned INTF0 @ 0x408;
+    REGISTER unsigned INTS0 @ 0x40c;
+    REGISTER unsigned INTE1 @ 0x414;
+    REGISTER unsigned INTF1 @ 0x418;
+    REGISTER unsigned INTS1 @ 0x41c;
+    REGISTER unsigned MULTI_CHAN_TRIGGER @ 0x430;
+    REGISTER unsigned CHAN_ABORT @ 0x444;
+};
+INSTANCE dma DMA @ 0x50000000;
+
+
 /* NVIC stuff */
 
 /* irq_priority -- set priority of an IRQ from 0 (highest) to 255 */
@@ -800,9 +898,16 @@ INLINE void gpio_set_func(unsigned pin, unsigned func) {
 
 /* Other convenience */
 
+/* Peripheral registers have aliases at +0x2000 and +0x3000 that set
+and clear bits atomically, so that processes on either core can share
+a register without losing each other's updates */
+#define REG_SET(reg) (* (&(reg) + 0x2000/4))
+#define REG_CLR(reg) (* (&(reg) + 0x3000/4))
+
+/* reset_subsystem -- pulse the reset of one peripheral */
 INLINE void reset_subsystem(unsigned bit) {
-    SET_BIT(RESETS_RESET, bit);
-    CLR_BIT(RESETS_RESET, bit);
+    REG_SET(RESETS_RESET) = BIT(bit);
+    REG_CLR(RESETS_RESET) = BIT(bit);
     while (!GET_BIT(RESETS_RESET_DONE, bit));
 }
 
@@ -80,8 +80,11 @@ argument to be a macro that expands the a 'position, width' pair. */
 #define TIMER1_IRQ 1
 #define TIMER2_IRQ 2
 #define TIMER3_IRQ 3
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
 #define UART0_IRQ 20
 #define UART1_IRQ 21
+#define ADC_IRQ 22
 #define I2C0_IRQ 23
 #define I2C1_IRQ 24
 #define RTC_IRQ 25
@@ -503,6 +506,10 @@ argument to be a macro that expands the a 'position, width' pair. */
 #define TIMER_DBGPAUSE                  _REG(unsigned, 0x4005402c)
 #define TIMER_PAUSE                     _REG(unsigned, 0x40054030)
 #define TIMER_INTR                      _REG(unsigned, 0x40054034)
+#define TIMER_INT_ALARM0 __BIT(0)
+#define TIMER_INT_ALARM1 __BIT(1)
+#define TIMER_INT_ALARM2 __BIT(2)
+#define TIMER_INT_ALARM3 __BIT(3)
 #define TIMER_INTE                      _REG(unsigned, 0x40054038)
 #define TIMER_INTF                      _REG(unsigned, 0x4005403c)
 #define TIMER_INTS                      _REG(unsigned, 0x40054040)
@@ -526,6 +533,10 @@ argument to be a macro that expands the a 'position, width' pair. */
 #define WATCHDOG_TICK_CYCLES __FIELD(0, 9)
 
 
+/* Two I2C buses; the external bus is the one used for the OLED */
+#define I2C_EXTERNAL 0
+#define N_I2CS 2
+
 /* 4.4.16 */
 #define I2C0_BASE                       _BASE(0x40044000)
 #define I2C0_CON                        _REG(unsigned, 0x40044000)
@@ -560,6 +571,19 @@ argument to be a macro that expands the a 'position, width' pair. */
 #define I2C0_FS_SCL_LCNT                _REG(unsigned, 0x40044020)
 #define I2C0_INTR_STAT                  _REG(unsigned, 0x4004402c)
 #define I2C0_INTR_MASK                  _REG(unsigned, 0x40044030)
+#define I2C_INTR_RX_UNDER    __BIT(0)
+#define I2C_INTR_RX_OVER     __BIT(1)
+#define I2C_INTR_RX_FULL     __BIT(2)
+#define I2C_INTR_TX_OVER     __BIT(3)
+#define I2C_INTR_TX_EMPTY    __BIT(4)
+#define I2C_INTR_RD_REQ      __BIT(5)
+#define I2C_INTR_TX_ABRT     __BIT(6)
+#define I2C_INTR_RX_DONE     __BIT(7)
+#define I2C_INTR_ACTIVITY    __BIT(8)
+#define I2C_INTR_STOP_DET    __BIT(9)
+#define I2C_INTR_START_DET   __BIT(10)
+#define I2C_INTR_GEN_CALL    __BIT(11)
+#define I2C_INTR_RESTART_DET __BIT(12)
 #define I2C0_RAW_INTR_STAT              _REG(unsigned, 0x40044034)
 #define I2C_RAW_INTR_STAT_TX_EMPTY   __BIT(4)
 #define I2C_RAW_INTR_STAT_R_TX_EMPTY_INACTIVE   0
@@ -585,9 +609,12 @@ argument to be a macro that expands the a 'position, width' pair. */
 #define I2C0_TXFLR                      _REG(unsigned, 0x40044074)
 #define I2C0_RXFLR                      _REG(unsigned, 0x40044078)
 #define I2C0_SDA_HOLD                   _REG(unsigned, 0x4004407c)
+#define I2C_SDA_HOLD_TX __FIELD(0, 16)
 #define I2C0_TX_ABRT_SOURCE             _REG(unsigned, 0x40044080)
 #define I2C0_SLV_DATA_NACK_ONLY         _REG(unsigned, 0x40044084)
 #define I2C0_DMA_CR                     _REG(unsigned, 0x40044088)
+#define I2C_DMA_CR_RDMAE __BIT(0)
+#define I2C_DMA_CR_TDMAE __BIT(1)
 #define I2C0_DMA_TDLR                   _REG(unsigned, 0x4004408c)
 #define I2C0_DMA_RDLR                   _REG(unsigned, 0x40044090)
 #define I2C0_SDA_SETUP                  _REG(unsigned, 0x40044094)
@@ -723,19 +750,86 @@ argument to be a macro that expands the a 'position, width' pair. */
 #define ADC_CS_EN __BIT(0)
 #define ADC_CS_TS_EN __BIT(1)
 #define ADC_CS_START_ONCE __BIT(2)
+#define ADC_CS_START_MANY __BIT(3)
 #define ADC_CS_READY __BIT(8)
 #define ADC_CS_ERR __BIT(9)
+#define ADC_CS_ERR_STICKY __BIT(10)
 #define ADC_CS_AINSEL __FIELD(12,3)
+#define ADC_CS_RROBIN __FIELD(16,5)
 #define ADC_RESULT                      _REG(unsigned, 0x4004c004)
 #define ADC_FCS                         _REG(unsigned, 0x4004c008)
+#define ADC_FCS_EN __BIT(0)
+#define ADC_FCS_SHIFT __BIT(1)
+#define ADC_FCS_ERR __BIT(2)
+#define ADC_FCS_DREQ_EN __BIT(3)
+#define ADC_FCS_EMPTY __BIT(8)
+#define ADC_FCS_FULL __BIT(9)
+#define ADC_FCS_UNDER __BIT(10)
+#define ADC_FCS_OVER __BIT(11)
+#define ADC_FCS_LEVEL __FIELD(16,4)
+#define ADC_FCS_THRESH __FIELD(24,4)
 #define ADC_FIFO                        _REG(unsigned, 0x4004c00c)
+#define ADC_FIFO_VAL __FIELD(0,12)
+#define ADC_FIFO_ERR __BIT(15)
 #define ADC_DIV                         _REG(unsigned, 0x4004c010)
 #define ADC_INTR                        _REG(unsigned, 0x4004c014)
+#define ADC_INTR_FIFO __BIT(0)
 #define ADC_INTE                        _REG(unsigned, 0x4004c018)
 #define ADC_INTF                        _REG(unsigned, 0x4004c01c)
 #define ADC_INTS                        _REG(unsigned, 0x4004c020)
 
 
+/* 2.5.7 */
+/* The 12 DMA channels each have a block of registers 0x40 apart;
+DMA_CHAN(n, reg) names register reg of channel n. */
+#define DMA0_BASE                       _BASE(0x50000000)
+#define DMA0_READ_ADDR                  _REG(unsigned, 0x50000000)
+#define DMA0_WRITE_ADDR                 _REG(unsigned, 0x50000004)
+#define DMA0_TRANS_COUNT                _REG(unsigned, 0x50000008)
+#define DMA0_CTRL_TRIG                  _REG(unsigned, 0x5000000c)
+#define DMA_CTRL_EN            __BIT(0)
+#define DMA_CTRL_HIGH_PRIORITY __BIT(1)
+#define DMA_CTRL_DATA_SIZE     __FIELD(2, 2)
+#define DMA_SIZE_BYTE              0
+#define DMA_SIZE_HALFWORD          1
+#define DMA_SIZE_WORD              2
+#define DMA_CTRL_INCR_READ     __BIT(4)
+#define DMA_CTRL_INCR_WRITE    __BIT(5)
+#define DMA_CTRL_RING_SIZE     __FIELD(6, 4)
+#define DMA_CTRL_RING_SEL      __BIT(10)
+#define DMA_CTRL_CHAIN_TO      __FIELD(11, 4)
+#define DMA_CTRL_TREQ_SEL      __FIELD(15, 6)
+#define DMA_CTRL_IRQ_QUIET     __BIT(21)
+#define DMA_CTRL_BSWAP         __BIT(22)
+#define DMA_CTRL_BUSY          __BIT(24)
+#define DMA_CTRL_WRITE_ERROR   __BIT(29)
+#define DMA_CTRL_READ_ERROR    __BIT(30)
+#define DMA0_AL1_CTRL                   _REG(unsigned, 0x50000010)
+#define DMA0_AL2_WRITE_ADDR_TRIG        _REG(unsigned, 0x5000002c)
+
+#define DMA_CHAN(n, reg) (* (&DMA0_##reg + 16*(n)))
+#define N_DMA_CHANS 12
+
+/* Data request signals for TREQ_SEL */
+#define DREQ_I2C0_TX 32
+#define DREQ_I2C0_RX 33
+#define DREQ_I2C1_TX 34
+#define DREQ_I2C1_RX 35
+#define DREQ_ADC 36
+#define DREQ_PERMANENT 0x3f
+
+#define DMA_BASE                        _BASE(0x50000000)
+#define DMA_INTR                        _REG(unsigned, 0x50000400)
+#define DMA_INTE0                       _REG(unsigned, 0x50000404)
+#define DMA_INTF0                       _REG(unsigned, 0x50000408)
+#define DMA_INTS0                       _REG(unsigned, 0x5000040c)
+#define DMA_INTE1                       _REG(unsigned, 0x50000414)
+#define DMA_INTF1                       _REG(unsigned, 0x50000418)
+#define DMA_INTS1                       _REG(unsigned, 0x5000041c)
+#define DMA_MULTI_CHAN_TRIGGER          _REG(unsigned, 0x50000430)
+#define DMA_CHAN_ABORT                  _REG(unsigned, 0x50000444)
+
+
 /* NVIC stuff */
 
 /* irq_priority -- set priority of an IRQ from 0 (highest) to 255 */
@@ -832,9 +926,16 @@ INLINE void gpio_set_func(unsigned pin, unsigned func) {
 
 /* Other convenience */
 
+/* Peripheral registers have aliases at +0x2000 and +0x3000 that set
+and clear bits atomically, so that processes on either core can share
+a register without losing each other's updates */
+#define REG_SET(reg) (* (&(reg) + 0x2000/4))
+#define REG_CLR(reg) (* (&(reg) + 0x3000/4))
+
+/* reset_subsystem -- pulse the reset of one peripheral */
 INLINE void reset_subsystem(unsigned bit) {
-    SET_BIT(RESETS_RESET, bit);
-    CLR_BIT(RESETS_RESET, bit);
+    REG_SET(RESETS_RESET) = BIT(bit);
+    REG_CLR(RESETS_RESET) = BIT(bit);
     while (!GET_BIT(RESETS_RESET_DONE, bit));
 }
 
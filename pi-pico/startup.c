@@ -8,35 +8,104 @@ void __init(void);
 void __start_core(void);
 
 /* The next four routines can be used in C compiler output, even if
-not mentioned in the source. */
+not mentioned in the source.  They are used for every message that is
+delivered, and to clear the bss segment, so memcpy, memmove and memset
+move a word at a time, four words to an iteration, whenever the
+addresses allow it.  The Cortex-M0+ faults on unaligned word accesses,
+so if source and destination are not congruent mod 4, we must fall
+back on moving bytes.  The optimize attribute stops GCC from
+recognising the loops and replacing them with calls to the very
+functions they implement. */
+
+#define NOPATTERN __attribute((optimize("no-tree-loop-distribute-patterns")))
+
+/* aligned -- test if a pointer is word-aligned */
+#define aligned(p) (((unsigned) (p) & 3) == 0)
 
 /* memcpy -- copy n bytes from src to dest (non-overlapping) */
-void *memcpy(void *dest, const void *src, unsigned n)
+void * NOPATTERN memcpy(void *dest, const void *src, unsigned n)
 {
     unsigned char *p = dest;
     const unsigned char *q = src;
+
+    if (n >= 8 && aligned((unsigned) p ^ (unsigned) q)) {
+        while (!aligned(p)) {
+            *p++ = *q++; n--;
+        }
+
+        unsigned *pw = (unsigned *) p;
+        const unsigned *qw = (const unsigned *) q;
+        while (n >= 16) {
+            unsigned a = qw[0], b = qw[1], c = qw[2], d = qw[3];
+            pw[0] = a; pw[1] = b; pw[2] = c; pw[3] = d;
+            pw += 4; qw += 4; n -= 16;
+        }
+        while (n >= 4) {
+            *pw++ = *qw++; n -= 4;
+        }
+        p = (unsigned char *) pw; q = (const unsigned char *) qw;
+    }
+
     while (n-- > 0) *p++ = *q++;
     return dest;
 }
 
 /* memmove -- copy n bytes from src to dest, allowing overlaps */
-void *memmove(void *dest, const void *src, unsigned n)
+void * NOPATTERN memmove(void *dest, const void *src, unsigned n)
 {
     unsigned char *p = dest;
     const unsigned char *q = src;
+
+    /* Copying upwards is safe if dest is below src, and memcpy never
+       writes a word before reading the words that come after it. */
     if (dest <= src)
-        while (n-- > 0) *p++ = *q++;
-    else {
-        p += n; q += n;
-        while (n-- > 0) *--p = *--q;
+        return memcpy(dest, src, n);
+
+    p += n; q += n;
+    if (n >= 8 && aligned((unsigned) p ^ (unsigned) q)) {
+        while (!aligned(p)) {
+            *--p = *--q; n--;
+        }
+
+        unsigned *pw = (unsigned *) p;
+        const unsigned *qw = (const unsigned *) q;
+        while (n >= 16) {
+            pw -= 4; qw -= 4; n -= 16;
+            unsigned a = qw[0], b = qw[1], c = qw[2], d = qw[3];
+            pw[3] = d; pw[2] = c; pw[1] = b; pw[0] = a;
+        }
+        while (n >= 4) {
+            *--pw = *--qw; n -= 4;
+        }
+        p = (unsigned char *) pw; q = (const unsigned char *) qw;
     }
+
+    while (n-- > 0) *--p = *--q;
     return dest;
 }
 
 /* memset -- set n bytes of dest to byte x */
-void *memset(void *dest, unsigned x, unsigned n)
+void * NOPATTERN memset(void *dest, unsigned x, unsigned n)
 {
     unsigned char *p = dest;
+
+    if (n >= 8) {
+        while (!aligned(p)) {
+            *p++ = x; n--;
+        }
+
+        unsigned *pw = (unsigned *) p;
+        unsigned w = (x & 0xff) * 0x01010101;
+        while (n >= 16) {
+            pw[0] = w; pw[1] = w; pw[2] = w; pw[3] = w;
+            pw += 4; n -= 16;
+        }
+        while (n >= 4) {
+            *pw++ = w; n -= 4;
+        }
+        p = (unsigned char *) pw;
+    }
+
     while (n-- > 0) *p++ = x;
     return dest;
 }
@@ -95,7 +164,8 @@ void __reset(void)
 
 
 /*don't reset ADC here as it won't startup without it's clocks being setup*/
-#define WANT_RESET (BIT(RESET_IO_BANK0) | BIT(RESET_PADS_BANK0) | BIT(RESET_PLL_SYS) | BIT(RESET_TIMER) | BIT(RESET_I2C0) )
+/*I2C0 and I2C1 are taken out of reset by their drivers when started*/
+#define WANT_RESET (BIT(RESET_IO_BANK0) | BIT(RESET_PADS_BANK0) | BIT(RESET_PLL_SYS) | BIT(RESET_TIMER) | BIT(RESET_DMA) )
     RESETS_RESET = 0xffffffff;
     RESETS_RESET &= ~(unsigned)WANT_RESET;
     while (~RESETS_RESET_DONE & WANT_RESET);
@@ -10,8 +10,8 @@ static int RADIO_TASK;
 
 /* Operating modes */
 #define DISABLED 0              /* Doing nothing */
-#define READY 1                 /* Initialised for reception */
 #define LISTENING 2             /* Waiting for a packet, DMA set up */
+#define SENDING 3               /* Transmitting from the queue */
 
 #define FREQ 7                  /* Frequency 2407 MHz */
 
@@ -20,13 +20,65 @@ runtime.  That means prefixing the packet with three bytes (version,
 group, protocol) and counting these three in the length: the STATLEN
 feature of the radio is not used. */
 
-static struct {
+typedef struct {
     byte length;                /* Packet length, including 3-byte prefix */
     byte version;               /* Version: always 1 */
     byte group;                 /* Radio group */
     byte protocol;              /* Protocol identifier: always 1 */
     byte data[RADIO_PACKET];    /* Payload */
-} packet_buffer;
+} packet;
+
+/* Packets to send wait in a queue of NTXQ buffers, so radio_send
+returns as soon as its packet is copied, and a burst of packets goes
+out back to back.  The hardware shortcuts do most of the work: each
+packet starts as soon as the transmitter is ready (READY_START), the
+radio is disabled at the end of it (END_DISABLE), and if another
+packet is waiting, it is enabled again for sending (DISABLED_TXEN), or
+for receiving (DISABLED_RXEN) after the last one if anyone is
+listening.  So there is just one interrupt per packet, at the END
+event, and the driver has the ramp-up time (about 130 usec) to set
+PACKETPTR for whatever comes next.  While the queue is full, the
+driver accepts only interrupts, so further senders wait in the kernel,
+as many as there are, until a packet has gone. */
+
+#define NTXQ 4
+
+static packet txq[NTXQ];
+static int tx_head = 0, tx_tail = 0, tx_count = 0;
+
+/* Once any process has asked for packets, the radio listens all the
+time, and received packets go into a ring of NPACKETS buffers: the
+radio fills ring[head], and as soon as a good packet has arrived, head
+moves on and the radio is started again on the next buffer, so packets
+that arrive in a burst are not lost while clients are busy.  Packets
+with a bad CRC or for another group never take a place in the ring.
+
+Each of up to NSUBS subscribers has its own place (tail) in the ring,
+and sees every packet that arrives after it subscribes, or those whose
+first byte matches its filter.  Packets wait in the ring until each
+subscriber asks for them with radio_receive.  If one subscriber falls
+a whole ring behind, it loses its oldest packets, and the others are
+not affected.  A process gives up its place with
+radio_subscribe(RADIO_UNSUBSCRIBE); when all places are taken, the
+place of a subscriber that has not asked for anything during a whole
+ring of packets is given to the newcomer, and otherwise the newcomer
+gets an error. */
+
+#define NPACKETS 8
+#define NSUBS 4
+
+static packet ring[NPACKETS];
+static int head = 0;            /* Buffer being filled */
+
+#define next(i) (((i)+1) % NPACKETS)
+
+static struct {
+    int pid;                    /* Subscriber, or 0 if unused */
+    int filter;                 /* First byte to match, or -1 for any */
+    int tail;                   /* Next packet to look at */
+    void *buffer;               /* Buffer if waiting, or NULL */
+    int idle;                   /* Packets kept since it last asked */
+} subscriber[NSUBS];
 
 /* group -- group id for radio messages */
 static volatile int group = 0;
@@ -56,110 +108,282 @@ static void init_radio() {
     RADIO_DATAWHITEIV = 0x18;
 }
 
-/* radio_await -- wait for expected interrupt */
-static void radio_await(unsigned volatile *event) {
-    receive(INTERRUPT, NULL);
-    assert(*event);
-    *event = 0;
-    clear_pending(RADIO_IRQ);
-    enable_irq(RADIO_IRQ);
+/* find_sub -- find or make the subscriber entry for a process, or
+   return -1 if there is no room */
+static int find_sub(int pid) {
+    int free = -1;
+
+    for (int i = 0; i < NSUBS; i++) {
+        if (subscriber[i].pid == pid) {
+            subscriber[i].idle = 0;
+            return i;
+        }
+        if (subscriber[i].pid == 0 && free < 0) free = i;
+    }
+
+    if (free < 0) {
+        // Reclaim the place of a subscriber that seems to have stopped
+        for (int i = 0; i < NSUBS; i++) {
+            if (subscriber[i].buffer == NULL
+                && subscriber[i].idle >= NPACKETS) {
+                free = i;
+                break;
+            }
+        }
+        if (free < 0) return -1;
+    }
+
+    subscriber[free].pid = pid;
+    subscriber[free].filter = -1;
+    subscriber[free].tail = head;
+    subscriber[free].buffer = NULL;
+    subscriber[free].idle = 0;
+    return free;
+}
+
+/* any_subs -- test if anyone is subscribed */
+static int any_subs(void) {
+    for (int i = 0; i < NSUBS; i++)
+        if (subscriber[i].pid != 0) return 1;
+    return 0;
+}
+
+/* deliver -- give a waiting subscriber its next packet, if any */
+static void deliver(int i) {
+    while (subscriber[i].buffer != NULL && subscriber[i].tail != head) {
+        packet *p = &ring[subscriber[i].tail];
+        int n = p->length-3;
+
+        subscriber[i].tail = next(subscriber[i].tail);
+        if (subscriber[i].filter >= 0
+            && (n == 0 || p->data[0] != subscriber[i].filter))
+            continue;
+
+        memcpy(subscriber[i].buffer, p->data, n);
+        subscriber[i].buffer = NULL;
+        send_int(subscriber[i].pid, REPLY, n);
+    }
+}
+
+/* keep_packet -- add the packet just received to the ring if it is
+   sound and for our group, returning whether it was kept */
+static int keep_packet(void) {
+    if (RADIO_CRCSTATUS == 0 || ring[head].group != group)
+        return 0;
+
+    head = next(head);
+
+    // A subscriber a whole ring behind loses its oldest packet
+    for (int i = 0; i < NSUBS; i++) {
+        if (subscriber[i].pid != 0 && subscriber[i].tail == head)
+            subscriber[i].tail = next(head);
+        if (subscriber[i].buffer == NULL) subscriber[i].idle++;
+    }
+
+    return 1;
+}
+
+/* radio_listen -- start the receiver on the next ring buffer */
+static void radio_listen(void) {
+    RADIO_PACKETPTR = &ring[head];
+    RADIO_PREFIX0 = group;
+    RADIO_START = 1;
+}
+
+/* radio_rx_enable -- enable the receiver, which starts when it is ready */
+static void radio_rx_enable(void) {
+    RADIO_PACKETPTR = &ring[head];
+    RADIO_PREFIX0 = group;
+    RADIO_SHORTS = BIT(RADIO_READY_START);
+    RADIO_RXEN = 1;
+}
+
+/* tx_queue -- copy a packet into the transmit queue */
+static void tx_queue(void *buf, int n) {
+    packet *p = &txq[tx_head];
+
+    p->length = n+3;
+    p->version = 1;
+    p->group = group;
+    p->protocol = 1;
+    memcpy(p->data, buf, n);
+    tx_head = (tx_head+1) % NTXQ;
+    tx_count++;
+}
+
+/* tx_shorts -- shortcuts for sending the packet at the queue tail */
+static unsigned tx_shorts(int listen) {
+    unsigned shorts = BIT(RADIO_READY_START) | BIT(RADIO_END_DISABLE);
+
+    // Say what follows the packet
+    if (tx_count > 1)
+        shorts |= BIT(RADIO_DISABLED_TXEN);
+    else if (listen)
+        shorts |= BIT(RADIO_DISABLED_RXEN);
+
+    return shorts;
+}
+
+/* radio_tx_enable -- start sending from the queue */
+static void radio_tx_enable(int listen) {
+    if (RADIO_STATE != 0) {
+        // Stop the receiver: it takes a microsecond or so
+        RADIO_SHORTS = 0;
+        RADIO_DISABLE = 1;
+        while (!RADIO_DISABLED) { }
+    }
+    RADIO_DISABLED = 0;
+
+    if (RADIO_END) {
+        // A packet arrived before the receiver stopped: keep it, and
+        // let the interrupt that may already be queued find nothing
+        RADIO_END = 0;
+        clear_pending(RADIO_IRQ);
+        if (keep_packet())
+            for (int i = 0; i < NSUBS; i++) deliver(i);
+    }
+
+    RADIO_PACKETPTR = &txq[tx_tail];
+    RADIO_PREFIX0 = group;
+    RADIO_SHORTS = tx_shorts(listen);
+    RADIO_TXEN = 1;
 }
 
 /* radio_task -- device driver for radio */
 static void radio_task(int dummy) {
     int mode = DISABLED;
-    int listener = 0;
-    int n;
-    void *buffer = NULL;
+    int listen = 0;             /* Whether anyone wants packets */
+    unsigned shorts;
+    int i;
     message m;
 
     init_radio();
 
     // Configure interrupts
-    RADIO_INTENSET =
-        BIT(RADIO_INT_READY) | BIT(RADIO_INT_END) | BIT(RADIO_INT_DISABLED);
+    RADIO_INTENSET = BIT(RADIO_INT_END);
     connect(RADIO_IRQ);
     enable_irq(RADIO_IRQ);
 
-    // Set packet buffer
-    RADIO_PACKETPTR = &packet_buffer;
-
     while (1) {
-        receive(ANY, &m);
+        // With the queue full, the radio is sending, and an interrupt
+        // will soon make room
+        receive((tx_count == NTXQ ? INTERRUPT : ANY), &m);
         switch (m.type) {
         case INTERRUPT:
-            // A packet has been received
-            if (!RADIO_END || mode != LISTENING)
+            if (!RADIO_END) {
+                // radio_tx_enable has dealt with the event already
+                enable_irq(RADIO_IRQ);
+                break;
+            }
+            if (mode == DISABLED)
                 panic("unexpected radio interrrupt");
             RADIO_END = 0;
             clear_pending(RADIO_IRQ);
             enable_irq(RADIO_IRQ);
 
-            if (RADIO_CRCSTATUS == 0 || packet_buffer.group != group) {
+            if (mode == SENDING) {
+                // A packet has gone: END_DISABLE follows within a few usec
+                shorts = RADIO_SHORTS;
+                while (!RADIO_DISABLED) { }
+                RADIO_DISABLED = 0;
+
+                tx_tail = (tx_tail+1) % NTXQ;
+                tx_count--;
+
+                if (shorts & BIT(RADIO_DISABLED_TXEN)) {
+                    // The transmitter is ramping up for the next packet
+                    RADIO_PACKETPTR = &txq[tx_tail];
+                    RADIO_SHORTS = tx_shorts(listen);
+                } else if (shorts & BIT(RADIO_DISABLED_RXEN)) {
+                    // The receiver is ramping up
+                    RADIO_PACKETPTR = &ring[head];
+                    RADIO_SHORTS = BIT(RADIO_READY_START);
+                    mode = LISTENING;
+                    if (tx_count > 0) {
+                        // More to send after all
+                        radio_tx_enable(listen);
+                        mode = SENDING;
+                    }
+                } else if (tx_count > 0) {
+                    // Another packet was queued too late for the shortcut
+                    radio_tx_enable(listen);
+                } else if (listen) {
+                    radio_rx_enable();
+                    mode = LISTENING;
+                } else {
+                    mode = DISABLED;
+                }
+                break;
+            }
+
+            // A packet has been received
+            if (!keep_packet()) {
                 // Ignore the packet and listen again
                 RADIO_START = 1;
                 break;
             }
 
-            n = packet_buffer.length-3;
-            memcpy(buffer, packet_buffer.data, n);
-
-            send_int(listener, REPLY, n);
-            mode = READY;
+            // Listen again straight away, then hand out the packet
+            radio_listen();
+            for (i = 0; i < NSUBS; i++) deliver(i);
             break;
 
+        case REGISTER:
+            if (m.int1 == RADIO_UNSUBSCRIBE) {
+                for (i = 0; i < NSUBS; i++) {
+                    if (subscriber[i].pid == m.sender)
+                        subscriber[i].pid = 0;
+                }
+
+                listen = any_subs();
+                if (!listen && mode == LISTENING) {
+                    // Nobody wants packets: stop the receiver
+                    RADIO_SHORTS = 0;
+                    RADIO_DISABLE = 1;
+                    while (!RADIO_DISABLED) { }
+                    RADIO_DISABLED = 0;
+                    RADIO_END = 0;
+                    clear_pending(RADIO_IRQ);
+                    mode = DISABLED;
+                }
+
+                send_int(m.sender, REPLY, OK);
+                break;
+            }
+            /* fall through */
+
         case RECEIVE:
-            if (mode == LISTENING)
-                panic("radio supports only one listener at a time");
-            listener = m.sender;
-            buffer = m.ptr1;
+            i = find_sub(m.sender);
+            if (i < 0) {
+                // No room for another subscriber
+                send_int(m.sender, REPLY, (m.type == REGISTER ? ERR : -1));
+                break;
+            }
+            listen = 1;
 
             if (mode == DISABLED) {
-                RADIO_RXEN = 1;
-                radio_await(&RADIO_READY);
+                radio_rx_enable();
+                mode = LISTENING;
             }
 
-            RADIO_PREFIX0 = group;
-            RADIO_START = 1;
-            mode = LISTENING;
+            if (m.type == REGISTER) {
+                subscriber[i].filter = m.int1;
+                send_int(m.sender, REPLY, OK);
+            } else {
+                subscriber[i].buffer = m.ptr1;
+                deliver(i);
+            }
             break;
 
         case SEND:
-            if (mode != DISABLED) {
-                // The radio was set up for receiving: disable it
-                RADIO_DISABLE = 1;
-                radio_await(&RADIO_DISABLED);
-            }
+            tx_queue(m.ptr1, m.int2);
+            send_msg(m.sender, REPLY);
 
-            // Assemble the packet
-            n = m.int2;
-            packet_buffer.length = n+3;
-            packet_buffer.version = 1;
-            packet_buffer.group = group;
-            packet_buffer.protocol = 1;
-            memcpy(packet_buffer.data, m.ptr1, n);
-
-            // Enable for sending and transmit the packet
-            RADIO_TXEN = 1;
-            radio_await(&RADIO_READY);
-            RADIO_PREFIX0 = group;
-            RADIO_START = 1;
-            radio_await(&RADIO_END);
-
-            // Disable the transmitter -- otherwise it jams the airwaves
-            RADIO_DISABLE = 1;
-            radio_await(&RADIO_DISABLED);
-
-            if (mode != LISTENING)
-                mode = DISABLED;
-            else {
-                // Go back to listening
-                RADIO_RXEN = 1;
-                radio_await(&RADIO_READY);
-                RADIO_START = 1;
+            // If sending already, the interrupt will find the packet
+            if (mode != SENDING) {
+                radio_tx_enable(listen);
+                mode = SENDING;
             }
-
-            send_msg(m.sender, REPLY);
             break;
 
         default:
@@ -173,7 +397,7 @@ void radio_group(int grp) {
     group = grp;
 }
 
-/* radio_send -- send radio packet */
+/* radio_send -- queue radio packet for sending */
 void radio_send(void *buf, int n) {
     message m;
     m.type = SEND;
@@ -182,7 +406,20 @@ void radio_send(void *buf, int n) {
     sendrec(RADIO_TASK, &m);
 }
 
-/* radio_receive -- receive radio packet and return length */
+/* radio_subscribe -- receive only packets whose first byte is filter,
+   or all packets if filter is -1; packets arriving from now on are
+   kept for the caller until it asks for them.  RADIO_UNSUBSCRIBE gives
+   up the caller's place.  Returns OK, or ERR if there is no room. */
+int radio_subscribe(int filter) {
+    message m;
+    m.type = REGISTER;
+    m.int1 = filter;
+    sendrec(RADIO_TASK, &m);
+    return m.int1;
+}
+
+/* radio_receive -- receive radio packet and return length, or -1 if
+   there is no room for another subscriber */
 int radio_receive(void *buf) {
     // buf must have space for RADIO_PACKET bytes
     message m;
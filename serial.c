@@ -24,6 +24,7 @@ static int SERIAL_TASK;
 #define PUTC 16
 #define GETC 17
 #define PUTBUF 18
+#define PUTRAW 19
 
 /* There are two buffers, one for characters waiting to be output, and
 another for input characters waiting to be read by other processes.
@@ -351,6 +352,17 @@ static void serial_task(int arg) {
             debug_in_serial(1);
             break;
 
+        case PUTRAW:
+            /* Binary data: no newline translation */
+            buf = m.ptr1;
+            n = m.int2;
+            for (int i = 0; i < n; i++)
+                queue_char(buf[i]);
+            debug_in_serial(0);
+            send_msg(client, REPLY);
+            debug_in_serial(1);
+            break;
+
         default:
             badmesg(m.type);
         }
@@ -389,3 +401,12 @@ void print_buf(char *buf, int n) {
     m.int2 = n;
     sendrec(SERIAL_TASK, &m);
 }
+
+/* serial_write -- output binary data without newline translation */
+void serial_write(const void *buf, int n) {
+    message m;
+    m.type = PUTRAW;
+    m.ptr1 = (void *) buf;
+    m.int2 = n;
+    sendrec(SERIAL_TASK, &m);
+}
@@ -12,7 +12,7 @@
  * @version     3.0.0
  * @tested      AVR Atmega328p
  *
- * @depend      font.h, twi.h
+ * @depend      fonts.h, twi.h
  * -------------------------------------------------------------------------------------+
  * @descr       Version 1.0.0 -> applicable for 1 display
  *              Version 2.0.0 -> rebuild to 'cacheMemLcd' array
@@ -29,11 +29,13 @@ typedef unsigned char byte;
 
   // includes
 //#include "microbian.h"
-  #include "font.h"
+  #include "fonts.h"
 //  #include "twi.h"
 
 //#define OK 1
+#ifndef I2C_EXTERNAL
 #define I2C_EXTERNAL 1
+#endif
 //#define WRITE 1
 
   // Success / Error
@@ -106,8 +108,9 @@ typedef unsigned char byte;
   //#define END_PAGE_ADDR             7     // 7 for 128x64, 3 for 128x32 version
   #define START_COLUMN_ADDR         0
   #define END_COLUMN_ADDR           127
-  #define RAM_X_END                 END_COLUMN_ADDR + 1
-  #define RAM_Y_END                 END_PAGE_ADDR + 1
+  #define RAM_X_END                 (END_COLUMN_ADDR + 1)
+  #define RAM_Y_END                 (END_PAGE_ADDR + 1)
+  #define RAM_PAGES                 8     // display RAM is 64 rows whatever the panel
 
   #define CACHE_SIZE_MEM            (1 + END_PAGE_ADDR) * (1 + END_COLUMN_ADDR)
 
@@ -124,12 +127,35 @@ int ssd1306_clear_screen(void);
 
 int ssd1306_start(void);
 int ssd1306_set_position(byte x, byte y);
+int ssd1306_set_font(const font *f, int scale, int prop);
 int ssd1306_draw_character(char ch);
 int ssd1306_draw_string(char *str);
-
-//wrapper idea for ssd1306_start
-#define OLED_READY 543 /*microbian message number for oled_task complete*/
-void ssd1306_init(int target_task);
+int ssd1306_flush(void);
+
+// graphics on the framebuffer, with x and y in pixels
+#define PIXEL_OFF 0
+#define PIXEL_ON 1
+#define PIXEL_XOR 2
+
+void ssd1306_pixel(int x, int y, int mode);
+void ssd1306_hline(int x, int y, int w, int mode);
+void ssd1306_vline(int x, int y, int h, int mode);
+void ssd1306_fill_rect(int x, int y, int w, int h, int mode);
+void ssd1306_cursor(int x, int y, int w, int h);
+void ssd1306_blit(int x, int y, const byte *bmp, int w, int h, int mode);
+
+// scrolling text console
+int ssd1306_console(int on);
+void ssd1306_console_write(const char *buf, int n);
+
+// driver process that owns the display
+void oled_init(int fps);
+void oled_clear(void);
+void oled_text(int x, int page, const char *str);
+void oled_font(const font *f, int scale, int prop);
+void oled_flush(void);
+void oled_console(int on);
+void oled_print_buf(char *buf, int n);
 
 
 
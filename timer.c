@@ -18,50 +18,94 @@ static int TIMER_TASK;
 #define TICK 1                  // initial 1ms systick rate
 #endif
 
-#define MAX_TIMERS 8
+/* Message types for the timer task */
+#define CANCEL 16
 
 /* Millis will overflow in about 46 days, but that's long enough. */
 
 /* millis -- milliseconds since boot */
 static unsigned millis = 0;
 
-/* timer -- array of data for pending timer messages */
-static struct {
-    int client;      /* Process that receives message, or -1 if empty */
+/* Pending timers are kept in a list sorted by expiry time, so that on
+each tick only the head of the list need be examined.  Timer records
+are allocated from the heap when first needed, and recycled through a
+free list, so there is no fixed limit on their number. */
+
+typedef struct _timer *timer;
+
+struct _timer {
+    int id;          /* Identifier for timer_cancel */
+    int client;      /* Process that receives message */
     unsigned period; /* Interval between messages, or 0 for one-shot */
     unsigned next;   /* Next time to send a message */
-} timer[MAX_TIMERS];
+    timer link;      /* Next timer in active list or free list */
+};
 
-/* check_timers is called by the timer task and sends messages
-   directly to clients.  We assume that each client is waiting to
-   receive a PING message: otherwise the progress of the entire system
-   will be held up, possibly leading to deadlock. */
+static timer active = NULL;     /* Pending timers, earliest first */
+static timer free_timers = NULL; /* Records ready for re-use */
+static int next_id = 1;         /* Identifier for next timer */
 
-/* check_timers -- send any messages that are due */
-static void check_timers(void)
+/* before -- test if time t1 is before t2, allowing for wraparound */
+#define before(t1, t2) ((int) ((t1) - (t2)) < 0)
+
+/* insert -- add a timer to the active list in order of expiry */
+static void insert(timer t)
 {
-    for (int i = 0; i < MAX_TIMERS; i++) {
-        if (timer[i].client >= 0 && millis >= timer[i].next) {
-            send_int(timer[i].client, PING, timer[i].next);
+    timer *pp = &active;
+
+    /* Timers due at the same time fire in order of insertion */
+    while (*pp != NULL && !before(t->next, (*pp)->next))
+        pp = &(*pp)->link;
+
+    t->link = *pp;
+    *pp = t;
+}
 
-            if (timer[i].period > 0)
-                timer[i].next += timer[i].period;
-            else
-                timer[i].client = -1;
+/* check_timers is called by the timer task and sends messages to
+   clients with ping(), which never blocks.  If a client is busy when
+   its timer expires, the PING is held by the kernel until the client
+   next calls receive(), so a slow client cannot hold up the clock or
+   other timers.  PINGs that pile up meanwhile are merged, and m.int2
+   in the one that is received says how many were missed.  The kernel
+   merges all the PINGs a process has not yet received, so a client may
+   have only one repeating timer: otherwise the count and the value
+   would belong to neither. */
 
+/* check_timers -- send any messages that are due */
+static void check_timers(void)
+{
+    while (active != NULL && !before(millis, active->next)) {
+        timer t = active;
+        active = t->link;
+
+        ping(t->client, t->next);
+
+        if (t->period > 0) {
+            t->next += t->period;
+            insert(t);
+        } else {
+            t->link = free_timers;
+            free_timers = t;
         }
     }
 }
 
-/* create -- create a new timer */
-static void create(int client, int delay, int repeat) {
-    int i = 0;
+/* create -- create a new timer and return its id, or -1 if the client
+   already has a repeating timer and asks for another */
+static int create(int client, int delay, int repeat) {
+    timer t;
 
-    while (i < MAX_TIMERS && timer[i].client >= 0)
-        i++;
+    if (repeat > 0) {
+        for (t = active; t != NULL; t = t->link)
+            if (t->client == client && t->period > 0) return -1;
+    }
 
-    if (i == MAX_TIMERS)
-        panic("Too many timers");
+    t = free_timers;
+
+    if (t != NULL)
+        free_timers = t->link;
+    else
+        t = alloc(sizeof(struct _timer));
 
     /* If we are between ticks when the timer is created, then the
        timer will go off up to one tick early.  We could add on a tick
@@ -70,9 +114,28 @@ static void create(int client, int delay, int repeat) {
        previous timer tick, and if it is created as a response to that
        tick, then the effect is what is usually wanted. */
 
-    timer[i].client = client;
-    timer[i].next = millis + delay;
-    timer[i].period = repeat;
+    t->id = next_id++;
+    t->client = client;
+    t->next = millis + delay;
+    t->period = repeat;
+    insert(t);
+    return t->id;
+}
+
+/* cancel -- delete a client's timer, returning OK or ERR */
+static int cancel(int client, int id) {
+    for (timer *pp = &active; *pp != NULL; pp = &(*pp)->link) {
+        timer t = *pp;
+        if (t->id == id && t->client == client) {
+            *pp = t->link;
+            t->link = free_timers;
+            free_timers = t;
+            return OK;
+        }
+    }
+
+    /* Perhaps a one-shot timer has already fired */
+    return ERR;
 }
 
 #ifndef PI_PICO
@@ -125,7 +188,11 @@ SYST_CSR = 0x7; //BIT(SYST_CSR_CLKSOURCE)|BIT(SYST_CSR_TICKINT)|BIT(SYST_CSR_ENA
             break;
 
         case REGISTER:
-            create(m.sender, m.int1, m.int2);
+            send_int(m.sender, REPLY, create(m.sender, m.int1, m.int2));
+            break;
+
+        case CANCEL:
+            send_int(m.sender, REPLY, cancel(m.sender, m.int1));
             break;
 
         default:
@@ -136,11 +203,6 @@ SYST_CSR = 0x7; //BIT(SYST_CSR_CLKSOURCE)|BIT(SYST_CSR_TICKINT)|BIT(SYST_CSR_ENA
 
 /* timer_init -- start the timer task */
 void timer_init(void) {
-    int i;
-
-    for (i = 0; i < MAX_TIMERS; i++)
-        timer[i].client = -1;
-
     TIMER_TASK = start("Timer", timer_task, 0, 256);
 }
 
@@ -153,10 +215,11 @@ unsigned timer_now(void) {
 if it does overflow, shorter durations can be measured by taking the
 difference of two readings with unsigned subtraction. */
 
-/* timer_micros -- return microseconds since startup */
-unsigned timer_micros(void) {
-    unsigned my_millis, ticks1, ticks2, extra;
 #ifndef PI_PICO
+/* read_clock -- return milliseconds and set *ticks to microseconds */
+static unsigned read_clock(unsigned *ticks) {
+    unsigned my_millis, ticks1, ticks2, extra;
+
     /* We must allow for the possibility the timer has expired but the
        interrupt has not yet been handled. Worse, the timer expiry
        could happen between looking at the timer and looking at the
@@ -178,22 +241,55 @@ unsigned timer_micros(void) {
     /* Correct my_millis if the timer expired */
     if (extra && ticks1 <= ticks2) my_millis += TICK;
 
-    return 1000 * my_millis + ticks1;
+    *ticks = ticks1;
+    return my_millis;
+}
+
+/* timer_micros -- return microseconds since startup */
+unsigned timer_micros(void) {
+    unsigned ticks, my_millis = read_clock(&ticks);
+    return 1000 * my_millis + ticks;
+}
 
+/* timer_micros64 -- return microseconds since startup as 64 bits */
+unsigned long long timer_micros64(void) {
+    /* This lasts as long as the millisecond count, for 49 days */
+    unsigned ticks, my_millis = read_clock(&ticks);
+    return (unsigned long long) my_millis * 1000 + ticks;
+}
 #else
-    intr_disable();
-    ticks1 = SYST_CVR & 0x00ffffff; //125000 counts in 1ms
-    my_millis = millis;
-    ticks2 = SYST_CVR & 0x00ffffff;
-    intr_enable();
-    extra = (125000 - ticks2)/125;
-    if (ticks1<ticks2) extra += 1000;
+/* On the RP2040, the 64-bit TIMER counts microseconds from reset on
+its own, so there is no need to combine the tick count with the state
+of a counter.  Reading TIMELR latches the high half for a following
+read of TIMEHR, but there is only one latch, shared by both cores and
+by any interrupt handler that reads the time in between.  Instead, we
+use the raw registers and read the high half before and after the low
+half: if it has not changed, the low half belongs with it.  The loop
+goes round again only if the low half wraps during the reads, which
+happens once every 71 minutes, so the cost is three bus reads without
+disabling interrupts. */
+
+/* timer_micros64 -- return microseconds since startup as 64 bits */
+unsigned long long timer_micros64(void) {
+    unsigned hi, lo, hi2;
+
+    hi = TIMER_TIMERAWH;
+    while (1) {
+        lo = TIMER_TIMERAWL;
+        hi2 = TIMER_TIMERAWH;
+        if (hi == hi2) break;
+        hi = hi2;
+    }
 
-   //need to work out how to handle missed tick situation
-    return 1000 * my_millis + extra;
+    return ((unsigned long long) hi << 32) | lo;
+}
 
-#endif
+/* timer_micros -- return microseconds since startup */
+unsigned timer_micros(void) {
+    /* The low half alone is consistent */
+    return TIMER_TIMERAWL;
 }
+#endif
 
 /* timer_delay -- one-shot delay */
 void timer_delay(int msec) {
@@ -201,20 +297,80 @@ void timer_delay(int msec) {
     m.type = REGISTER;
     m.int1 = msec;
     m.int2 = 0;                 /* Don't repeat */
-    send(TIMER_TASK, &m);
+    sendrec(TIMER_TASK, &m);
     receive(PING, NULL);
 }
 
-/* timer_pulse -- regular pulse */
-void timer_pulse(int msec) {
+/* timer_delay_us -- one-shot delay in microseconds */
+void timer_delay_us(unsigned usec) {
+    /* Nothing but the timeout will ever be accepted */
+    receive_us(TIMEOUT, NULL, usec);
+}
+
+/* A periodic activity computes each release time by adding the period
+to the last one, not to the time it woke up, so lateness in waking or
+in running the loop body does not accumulate.  If the loop overruns so
+badly that whole periods are missed, those releases are skipped rather
+than run back-to-back, and periodic_wait says how many were lost.  A
+client that must handle other messages meanwhile can use
+receive_until(ANY, &m, p.release + p.period) in place of
+periodic_wait, then call periodic_wait when the timeout arrives.
+
+On the micro:bit, the waits are made with the millisecond tick, so each
+release may come up to a tick late, but the lateness does not add up
+from one period to the next.  Deadlines are compared with wraparound on
+the 32-bit microsecond clock, so one more than 2^31 usec (about 35
+minutes) ahead would look as if it had passed already: the period must
+be shorter than that. */
+
+/* periodic_init -- start a periodic activity with its first release now */
+void periodic_init(periodic *p, unsigned period) {
+    assert(period > 0 && period < 0x80000000u);
+    p->release = timer_micros();
+    p->period = period;
+}
+
+/* periodic_wait -- wait for next release, returning number missed */
+int periodic_wait(periodic *p) {
+    unsigned next = p->release + p->period;
+    unsigned late;
+    int missed = 0;
+
+    receive_until(TIMEOUT, NULL, next);
+
+    late = timer_micros() - next;
+    if (late >= p->period) {
+        missed = late / p->period;
+        next += missed * p->period;
+    }
+
+    p->release = next;
+    return missed;
+}
+
+/* timer_pulse -- regular pulse; returns id for timer_cancel, or -1 if
+   the caller has a pulse already */
+int timer_pulse(int msec) {
     message m;
     m.type = REGISTER;
     m.int1 = msec;
     m.int2 = msec;              /* Repetitive */
-    send(TIMER_TASK, &m);
+    sendrec(TIMER_TASK, &m);
+    return m.int1;
 }
 
-/* wait -- sleep until next timer pulse */
-void timer_wait(void) {
-    receive(PING, NULL);
+/* timer_cancel -- stop a timer set by timer_pulse */
+int timer_cancel(int id) {
+    message m;
+    m.type = CANCEL;
+    m.int1 = id;
+    sendrec(TIMER_TASK, &m);
+    return m.int1;
+}
+
+/* wait -- sleep until next timer pulse, returning number missed */
+int timer_wait(void) {
+    message m;
+    receive(PING, &m);
+    return m.int2;
 }
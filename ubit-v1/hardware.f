@@ -407,6 +407,12 @@ DEVICE radio {
 #define RADIO_INT_READY 0
 #define RADIO_INT_END 3
 #define RADIO_INT_DISABLED 4
+/* Shortcuts */
+#define RADIO_READY_START 0
+#define RADIO_END_DISABLE 1
+#define RADIO_DISABLED_TXEN 2
+#define RADIO_DISABLED_RXEN 3
+#define RADIO_END_START 5
 
 INSTANCE radio RADIO @ 0x40001000;
 
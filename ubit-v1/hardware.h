@@ -318,6 +318,12 @@ typedef struct { unsigned volatile *EEP, *TEP; } ppi_chan;
 #define RADIO_INT_READY 0
 #define RADIO_INT_END 3
 #define RADIO_INT_DISABLED 4
+/* Shortcuts */
+#define RADIO_READY_START 0
+#define RADIO_END_DISABLE 1
+#define RADIO_DISABLED_TXEN 2
+#define RADIO_DISABLED_RXEN 3
+#define RADIO_END_START 5
 
 #define RADIO_BASE                      _BASE(0x40001000)
 /* Tasks */
@@ -480,6 +480,12 @@ DEVICE radio {
 #define RADIO_INT_READY 0
 #define RADIO_INT_END 3
 #define RADIO_INT_DISABLED 4
+/* Shortcuts */
+#define RADIO_READY_START 0
+#define RADIO_END_DISABLE 1
+#define RADIO_DISABLED_TXEN 2
+#define RADIO_DISABLED_RXEN 3
+#define RADIO_END_START 5
 
 INSTANCE radio RADIO @ 0x40001000;
 
@@ -606,6 +612,7 @@ DEVICE i2c {
     REGISTER unsigned ERROR @ 0x124;
     REGISTER unsigned BB @ 0x138;
     REGISTER unsigned SUSPENDED @ 0x148;
+    REGISTER unsigned LASTTX @ 0x160;      /* TWIM only */
 /* Registers */
     REGISTER unsigned SHORTS @ 0x200;
     REGISTER unsigned INTEN @ 0x300;
@@ -619,12 +626,17 @@ DEVICE i2c {
     REGISTER unsigned ENABLE @ 0x500;
 #define   I2C_ENABLE_Disabled 0
 #define   I2C_ENABLE_Enabled 5
+#define   I2C_ENABLE_EnabledTWIM 6
     REGISTER unsigned PSELSCL @ 0x508;
     REGISTER unsigned PSELSDA @ 0x50c;
     REGISTER unsigned RXD @ 0x518;
     REGISTER unsigned TXD @ 0x51c;
     REGISTER unsigned FREQUENCY @ 0x524;
 #define   I2C_FREQUENCY_100kHz 0x01980000
+/* EasyDMA, for TWIM */
+    REGISTER unsigned TXD_PTR @ 0x544;
+    REGISTER unsigned TXD_MAXCNT @ 0x548;
+    REGISTER unsigned TXD_AMOUNT @ 0x54c;
     REGISTER unsigned ADDRESS @ 0x588;
     REGISTER unsigned POWER @ 0xffc;
 };
@@ -638,6 +650,7 @@ DEVICE i2c {
 /* Shortcuts */
 #define I2C_BB_SUSPEND 0
 #define I2C_BB_STOP 1
+#define I2C_LASTTX_STOP 9       /* TWIM only */
 
 INSTANCE i2c I2C0 @ 0x40003000;
 
@@ -393,6 +393,12 @@ typedef struct { unsigned volatile *EEP, *TEP; } ppi_chan;
 #define RADIO_INT_READY 0
 #define RADIO_INT_END 3
 #define RADIO_INT_DISABLED 4
+/* Shortcuts */
+#define RADIO_READY_START 0
+#define RADIO_END_DISABLE 1
+#define RADIO_DISABLED_TXEN 2
+#define RADIO_DISABLED_RXEN 3
+#define RADIO_END_START 5
 
 #define RADIO_BASE                      _BASE(0x40001000)
 /* Tasks */
@@ -630,6 +636,7 @@ typedef struct { unsigned volatile *EEP, *TEP; } ppi_chan;
 /* Shortcuts */
 #define I2C_BB_SUSPEND 0
 #define I2C_BB_STOP 1
+#define I2C_LASTTX_STOP 9       /* TWIM only */
 
 #define I2C0_BASE                       _BASE(0x40003000)
 /* Tasks */
@@ -645,6 +652,7 @@ typedef struct { unsigned volatile *EEP, *TEP; } ppi_chan;
 #define I2C0_ERROR                      _REG(unsigned, 0x40003124)
 #define I2C0_BB                         _REG(unsigned, 0x40003138)
 #define I2C0_SUSPENDED                  _REG(unsigned, 0x40003148)
+#define I2C0_LASTTX                     _REG(unsigned, 0x40003160)
 /* Registers */
 #define I2C0_SHORTS                     _REG(unsigned, 0x40003200)
 #define I2C0_INTEN                      _REG(unsigned, 0x40003300)
@@ -658,12 +666,17 @@ typedef struct { unsigned volatile *EEP, *TEP; } ppi_chan;
 #define I2C0_ENABLE                     _REG(unsigned, 0x40003500)
 #define   I2C_ENABLE_Disabled 0
 #define   I2C_ENABLE_Enabled 5
+#define   I2C_ENABLE_EnabledTWIM 6
 #define I2C0_PSELSCL                    _REG(unsigned, 0x40003508)
 #define I2C0_PSELSDA                    _REG(unsigned, 0x4000350c)
 #define I2C0_RXD                        _REG(unsigned, 0x40003518)
 #define I2C0_TXD                        _REG(unsigned, 0x4000351c)
 #define I2C0_FREQUENCY                  _REG(unsigned, 0x40003524)
 #define   I2C_FREQUENCY_100kHz 0x01980000
+/* EasyDMA, for TWIM */
+#define I2C0_TXD_PTR                    _REG(unsigned, 0x40003544)
+#define I2C0_TXD_MAXCNT                 _REG(unsigned, 0x40003548)
+#define I2C0_TXD_AMOUNT                 _REG(unsigned, 0x4000354c)
 #define I2C0_ADDRESS                    _REG(unsigned, 0x40003588)
 #define I2C0_POWER                      _REG(unsigned, 0x40003ffc)
 
@@ -679,6 +692,7 @@ typedef struct { unsigned volatile *EEP, *TEP; } ppi_chan;
 #define I2C1_ERROR                      _REG(unsigned, 0x40004124)
 #define I2C1_BB                         _REG(unsigned, 0x40004138)
 #define I2C1_SUSPENDED                  _REG(unsigned, 0x40004148)
+#define I2C1_LASTTX                     _REG(unsigned, 0x40004160)
 #define I2C1_SHORTS                     _REG(unsigned, 0x40004200)
 #define I2C1_INTEN                      _REG(unsigned, 0x40004300)
 #define I2C1_INTENSET                   _REG(unsigned, 0x40004304)
@@ -690,6 +704,9 @@ typedef struct { unsigned volatile *EEP, *TEP; } ppi_chan;
 #define I2C1_RXD                        _REG(unsigned, 0x40004518)
 #define I2C1_TXD                        _REG(unsigned, 0x4000451c)
 #define I2C1_FREQUENCY                  _REG(unsigned, 0x40004524)
+#define I2C1_TXD_PTR                    _REG(unsigned, 0x40004544)
+#define I2C1_TXD_MAXCNT                 _REG(unsigned, 0x40004548)
+#define I2C1_TXD_AMOUNT                 _REG(unsigned, 0x4000454c)
 #define I2C1_ADDRESS                    _REG(unsigned, 0x40004588)
 #define I2C1_POWER                      _REG(unsigned, 0x40004ffc)
 